@@ -0,0 +1,292 @@
+#ifndef BROADCAST_QUEUE
+#define BROADCAST_QUEUE
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "ringBuffer.hpp"
+#include "semaphore.hpp"
+
+namespace mq {
+
+// Publish/subscribe channel in the style of the LMAX Disruptor: every message
+// is stored once, in a ring, and each subscriber reads it in place through a
+// cursor of its own, so fan-out costs neither copies nor memory per
+// subscriber. A slot counts the subscribers that have yet to go past it, and
+// the last one destroys the message; publishers wait for the slowest
+// subscriber before reusing the slot.
+// A subscriber sees what is published after it subscribed, optionally only
+// the messages its topic predicate accepts. Publishers are serialized by a
+// mutex; reading never locks.
+// The capacity is rounded up to a power of two. Subscribers must not outlive
+// the queue.
+template <std::movable Mtype>
+class BroadcastQueue {
+    using Clock = std::chrono::steady_clock;
+
+    inline static constexpr std::size_t s_default_size{1024};
+    inline static constexpr Clock::time_point s_no_wait{Clock::time_point::min()};
+    inline static constexpr Clock::time_point s_forever{Clock::time_point::max()};
+
+    struct Slot {
+        std::optional<Mtype> msg{};
+        // Subscribers that have not gone past the message yet.
+        std::atomic<std::size_t> remaining{0};
+    };
+
+    struct alignas(cache_line_size) Cursor {
+        explicit Cursor(std::size_t position_, std::function<bool(Mtype const &)> wants_)
+            : position{position_}
+            , wants{std::move(wants_)} {}
+
+        // Next sequence to read. Written by its subscriber only.
+        std::atomic<std::size_t> position;
+        std::function<bool(Mtype const &)> wants;
+    };
+
+public:
+    using value_type = Mtype;
+
+    // Reading end of one subscriber. Move-only; unsubscribes on
+    // destruction. Functions passed to the read calls get the message by
+    // const reference and must not keep it: the slot is reused afterwards.
+    class Subscriber {
+    public:
+        Subscriber(Subscriber const &) = delete;
+        Subscriber &operator=(Subscriber const &) = delete;
+        Subscriber(Subscriber &&other) noexcept
+            : queue{std::exchange(other.queue, nullptr)}
+            , cursor{std::exchange(other.cursor, nullptr)} {}
+        Subscriber &operator=(Subscriber &&other) noexcept {
+            if (this != &other) {
+                unsubscribe();
+                queue = std::exchange(other.queue, nullptr);
+                cursor = std::exchange(other.cursor, nullptr);
+            }
+            return *this;
+        }
+        ~Subscriber() { unsubscribe(); }
+
+        // Calls fn on the next message for this subscriber, if one has been
+        // published. Never waits.
+        bool try_read(std::invocable<Mtype const &> auto &&fn) {
+            return read_bulk(fn, 1) == 1;
+        }
+
+        // Waits for the next message for this subscriber.
+        void read(std::invocable<Mtype const &> auto &&fn) { read_until(fn, s_forever); }
+
+        bool read_until(std::invocable<Mtype const &> auto &&fn, Clock::time_point deadline) {
+            for (;;) {
+                if (try_read(fn)) { return true; }
+                auto const key = queue->published_event.prepare_wait();
+                if (try_read(fn)) {
+                    queue->published_event.cancel_wait();
+                    return true;
+                }
+                if (deadline != s_forever && Clock::now() >= deadline) {
+                    queue->published_event.cancel_wait();
+                    return false;
+                }
+                if (deadline == s_forever) {
+                    queue->published_event.wait(key);
+                } else {
+                    queue->published_event.wait_until(key, deadline);
+                }
+            }
+        }
+
+        template <typename Rep, typename Period>
+        bool read_for(std::invocable<Mtype const &> auto &&fn,
+                      std::chrono::duration<Rep, Period> const &timeout) {
+            return read_until(fn, Clock::now() + std::chrono::ceil<Clock::duration>(timeout));
+        }
+
+        // Calls fn on up to max_n messages already published, then moves the
+        // cursor once for all of them. Never waits. Returns how many messages
+        // fn was called on.
+        std::size_t read_bulk(std::invocable<Mtype const &> auto &&fn, std::size_t max_n) {
+            auto pos = cursor->position.load(std::memory_order_relaxed);
+            auto const end = queue->published.load(std::memory_order_acquire);
+            std::size_t n{0};
+            bool freed{false};
+            for (; pos != end && n < max_n; ++pos) {
+                auto &slot = queue->slots[pos & queue->mask];
+                auto const &msg = *slot.msg;
+                if (!cursor->wants || std::invoke(cursor->wants, msg)) {
+                    std::invoke(fn, msg);
+                    ++n;
+                }
+                freed = pass(slot) || freed;
+            }
+            if (pos != cursor->position.load(std::memory_order_relaxed)) {
+                cursor->position.store(pos, std::memory_order_release);
+                // Room only shows up when the slowest subscriber moves,
+                // which is when it frees a slot.
+                if (freed) { queue->space_event.notify_all(); }
+            }
+            return n;
+        }
+
+        // Messages published that this subscriber has not gone past yet.
+        [[nodiscard]] std::size_t lag() const noexcept {
+            return queue->published.load(std::memory_order_relaxed)
+                   - cursor->position.load(std::memory_order_relaxed);
+        }
+
+        // Stops holding publishers back before destruction.
+        void unsubscribe() {
+            if (queue != nullptr) { std::exchange(queue, nullptr)->remove(*cursor); }
+        }
+
+    private:
+        friend class BroadcastQueue;
+        Subscriber(BroadcastQueue &queue_, Cursor &cursor_)
+            : queue{&queue_}
+            , cursor{&cursor_} {}
+
+        BroadcastQueue *queue;
+        Cursor *cursor;
+    };
+
+    explicit BroadcastQueue(std::size_t capacity_ = s_default_size)
+        : capacity{std::bit_ceil(capacity_ == 0 ? std::size_t{1} : capacity_)}
+        , mask{capacity - 1}
+        , slots{std::make_unique<Slot[]>(capacity)} {}  // NOLINT
+    BroadcastQueue(BroadcastQueue const &) = delete;
+    BroadcastQueue(BroadcastQueue &&) = delete;
+    BroadcastQueue &operator=(BroadcastQueue const &) = delete;
+    BroadcastQueue &operator=(BroadcastQueue &&) = delete;
+    ~BroadcastQueue() = default;
+
+    // Every message published from now on.
+    Subscriber subscribe() { return subscribe(std::function<bool(Mtype const &)>{}); }
+
+    // The messages published from now on that topic accepts. The others are
+    // skipped without calling the read function.
+    Subscriber subscribe(std::predicate<Mtype const &> auto topic) {
+        std::lock_guard lck{mutex};
+        auto &cursor = cursors.emplace_back(published.load(std::memory_order_relaxed),
+                                            std::function<bool(Mtype const &)>{std::move(topic)});
+        return Subscriber{*this, cursor};
+    }
+
+    // Waits while the slowest subscriber is a whole ring behind. With no
+    // subscriber, nothing waits and nobody sees the message.
+    bool publish(Mtype &&msg) { return emplace_until(s_forever, std::move(msg)); }
+
+    // Returns false, leaving msg untouched, if the ring is full.
+    bool try_publish(Mtype &&msg) { return emplace_until(s_no_wait, std::move(msg)); }
+
+    bool publish_until(Mtype &&msg, Clock::time_point deadline) {
+        return emplace_until(deadline, std::move(msg));
+    }
+
+    // Builds the message straight into its slot.
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return emplace_until(s_forever, std::forward<Args>(args)...);
+    }
+
+    [[nodiscard]] std::size_t max_size() const noexcept { return capacity; }
+    [[nodiscard]] std::size_t subscriber_count() const {
+        std::lock_guard lck{mutex};
+        return cursors.size();
+    }
+
+private:
+    template <typename... Args>
+    bool emplace_until(Clock::time_point deadline, Args &&...args) {
+        std::unique_lock lck{mutex};
+        while (!has_room()) {
+            if (deadline == s_no_wait) { return false; }
+            auto const key = space_event.prepare_wait();
+            if (has_room()) {
+                space_event.cancel_wait();
+                break;
+            }
+            lck.unlock();
+            if (deadline == s_forever) {
+                space_event.wait(key);
+            } else if (Clock::now() < deadline) {
+                space_event.wait_until(key, deadline);
+            } else {
+                space_event.cancel_wait();
+                return false;
+            }
+            lck.lock();
+        }
+        auto const pos = published.load(std::memory_order_relaxed);
+        auto &slot = slots[pos & mask];
+        // Nobody would go past the message to destroy it.
+        if (!cursors.empty()) {
+            slot.msg.emplace(std::forward<Args>(args)...);
+            slot.remaining.store(cursors.size(), std::memory_order_relaxed);
+        }
+        published.store(pos + 1, std::memory_order_release);
+        lck.unlock();
+        published_event.notify_all();
+        return true;
+    }
+
+    // Called with the mutex held. Only looks at the cursors once the cached
+    // position of the slowest subscriber says the ring is full.
+    bool has_room() {
+        auto const pos = published.load(std::memory_order_relaxed);
+        if (pos - slowest < capacity) { return true; }
+        slowest = pos;
+        for (auto const &cursor : cursors) {
+            slowest = std::min(slowest, cursor.position.load(std::memory_order_acquire));
+        }
+        return pos - slowest < capacity;
+    }
+
+    // Destroys the message if the caller was the last subscriber to go past
+    // it. Returns whether it did.
+    static bool pass(Slot &slot) {
+        if (slot.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) { return false; }
+        slot.msg.reset();
+        return true;
+    }
+
+    void remove(Cursor &cursor) {
+        {
+            // The mutex keeps publishers out, so every slot up to published
+            // counts this cursor.
+            std::lock_guard lck{mutex};
+            auto const end = published.load(std::memory_order_relaxed);
+            for (auto pos = cursor.position.load(std::memory_order_relaxed); pos != end; ++pos) {
+                pass(slots[pos & mask]);
+            }
+            cursors.remove_if([&cursor](Cursor const &c) { return &c == &cursor; });
+        }
+        space_event.notify_all();
+    }
+
+    std::size_t capacity;
+    std::size_t mask;
+    std::unique_ptr<Slot[]> slots;  // NOLINT
+    mutable std::mutex mutex{};
+    // Guarded by mutex: cursors, and slowest, no newer than any cursor.
+    std::list<Cursor> cursors{};
+    std::size_t slowest{0};
+    // Next sequence to publish.
+    alignas(cache_line_size) std::atomic<std::size_t> published{0};
+    alignas(cache_line_size) sem::EventCount published_event{};
+    alignas(cache_line_size) sem::EventCount space_event{};
+};
+}  // namespace mq
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef CHASE_LEV_DEQUE
+#define CHASE_LEV_DEQUE
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "ringBuffer.hpp"
+
+namespace mq {
+
+// Chase-Lev work-stealing deque (in the formulation of Le et al., PPoPP'13).
+// Its owner thread pushes and takes at the bottom, LIFO, without any
+// read-modify-write unless a single element is left; any other thread steals
+// from the top, FIFO, with one CAS. The array doubles when full. Arrays it
+// outgrew are kept until destruction, since a thief may still be reading one.
+// Elements are copied around unsynchronised, hence trivially copyable; to
+// hold anything else, store pointers.
+template <typename T>
+    requires std::is_trivially_copyable_v<T>
+class ChaseLevDeque {
+    struct Array {
+        explicit Array(std::size_t capacity_)
+            : capacity{capacity_}
+            , mask{capacity_ - 1}
+            , cells{std::make_unique<std::atomic<T>[]>(capacity_)} {}  // NOLINT
+
+        [[nodiscard]] T get(std::int64_t i) const {
+            return cells[static_cast<std::size_t>(i) & mask].load(std::memory_order_relaxed);
+        }
+        void put(std::int64_t i, T value) {
+            cells[static_cast<std::size_t>(i) & mask].store(value, std::memory_order_relaxed);
+        }
+
+        std::size_t capacity;
+        std::size_t mask;
+        std::unique_ptr<std::atomic<T>[]> cells;  // NOLINT
+    };
+
+    inline static constexpr std::size_t s_default_size{64};
+
+public:
+    enum class StealResult {
+        TAKEN,
+        EMPTY,
+        // Another thief or the owner got the element first: worth retrying.
+        LOST_RACE,
+    };
+
+    // The capacity is rounded up to a power of two.
+    explicit ChaseLevDeque(std::size_t capacity = s_default_size) {
+        arrays.push_back(std::make_unique<Array>(std::bit_ceil(capacity == 0 ? std::size_t{1} : capacity)));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+    ChaseLevDeque(ChaseLevDeque const &) = delete;
+    ChaseLevDeque(ChaseLevDeque &&) = delete;
+    ChaseLevDeque &operator=(ChaseLevDeque const &) = delete;
+    ChaseLevDeque &operator=(ChaseLevDeque &&) = delete;
+    ~ChaseLevDeque() = default;
+
+    // Owner only.
+    void push(T value) {
+        auto const b = bottom.load(std::memory_order_relaxed);
+        auto const t = top.load(std::memory_order_acquire);
+        auto *a = array.load(std::memory_order_relaxed);
+        if (static_cast<std::size_t>(b - t) >= a->capacity) { a = grow(*a, t, b); }
+        a->put(b, value);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only: the element pushed last.
+    std::optional<T> take() {
+        auto const b = bottom.load(std::memory_order_relaxed) - 1;
+        auto *a = array.load(std::memory_order_relaxed);
+        // Claims the bottom before looking at top; seq_cst on both sides
+        // orders this store with the thieves' loads.
+        bottom.store(b, std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_seq_cst);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return {};
+        }
+        std::optional<T> value{a->get(b)};
+        if (t == b) {
+            // Last element: race the thieves for it.
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                value.reset();
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    // Any thread: the element pushed first.
+    StealResult steal(T &out) {
+        auto t = top.load(std::memory_order_seq_cst);
+        auto const b = bottom.load(std::memory_order_seq_cst);
+        if (t >= b) { return StealResult::EMPTY; }
+        auto const value = array.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return StealResult::LOST_RACE;
+        }
+        out = value;
+        return StealResult::TAKEN;
+    }
+
+    // Only a snapshot: other threads may change it right away.
+    [[nodiscard]] std::size_t size() const noexcept {
+        auto const b = bottom.load(std::memory_order_relaxed);
+        auto const t = top.load(std::memory_order_relaxed);
+        return b > t ? static_cast<std::size_t>(b - t) : 0;
+    }
+
+private:
+    Array *grow(Array const &old, std::int64_t t, std::int64_t b) {
+        arrays.push_back(std::make_unique<Array>(old.capacity * 2));
+        auto *a = arrays.back().get();
+        for (auto i = t; i < b; ++i) { a->put(i, old.get(i)); }
+        array.store(a, std::memory_order_release);
+        return a;
+    }
+
+    alignas(cache_line_size) std::atomic<std::int64_t> top{0};
+    alignas(cache_line_size) std::atomic<std::int64_t> bottom{0};
+    std::atomic<Array *> array{nullptr};
+    // Owner only.
+    std::vector<std::unique_ptr<Array>> arrays{};
+};
+}  // namespace mq
+
+#endif
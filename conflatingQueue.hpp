@@ -0,0 +1,268 @@
+#ifndef CONFLATING_QUEUE
+#define CONFLATING_QUEUE
+
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include "messageQueue.hpp"
+
+namespace mq {
+
+// FIFO queue of "latest value for a key" updates. Enqueuing a message whose
+// key (as projected by KeyFn) is already pending replaces the pending message
+// where it stands, so a consumer that falls behind sees each key at most once
+// and the queue never holds more messages than there are distinct keys.
+// Only a new key needs room: replacing never waits, even when the queue is
+// full.
+template <std::movable Mtype, typename KeyFn>
+    requires std::regular_invocable<KeyFn const &, Mtype const &>
+class ConflatingQueue {
+    using Clock = std::chrono::steady_clock;
+
+    inline static constexpr std::size_t s_default_size{1000};
+    inline static constexpr Clock::time_point s_no_wait{Clock::time_point::min()};
+    inline static constexpr Clock::time_point s_forever{Clock::time_point::max()};
+
+public:
+    using value_type = Mtype;
+    using key_type = std::remove_cvref_t<std::invoke_result_t<KeyFn const &, Mtype const &>>;
+
+    explicit ConflatingQueue(KeyFn key_of_ = {}, std::size_t max_size_ = s_default_size)
+        : key_of{std::move(key_of_)}
+        , capacity{max_size_} {}
+
+    // Producer side. A message that was not accepted is left untouched.
+    bool enqueue(Mtype &&msg) { return enqueue_until(std::move(msg), s_forever); }
+
+    bool try_enqueue(Mtype &&msg) { return enqueue_until(std::move(msg), s_no_wait); }
+
+    bool enqueue_until(Mtype &&msg, Clock::time_point deadline) {
+        std::unique_lock lck{mutex};
+        auto key = std::invoke(key_of, std::as_const(msg));
+        if (!wait_for_room(lck, key, deadline)) { return false; }
+        put(std::move(key), std::move(msg));
+        return true;
+    }
+
+    // Keeps msg out of the queue until due, then enqueues it from a timer
+    // thread started on first use.
+    void enqueue_at(Mtype &&msg, Clock::time_point due) {
+        std::call_once(delayed_once, [this] {
+            delayed = std::make_unique<DelayLine<Mtype, ConflatingQueue>>(*this, true);
+        });
+        delayed->schedule(std::move(msg), due);
+    }
+
+    // The key is only known once the message exists, so it is built first
+    // and then moved in.
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return try_enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    // Waits for room for the first message only, then accepts messages
+    // until one with a new key finds the queue full. Messages are only moved
+    // once accepted: the rest are left untouched.
+    template <std::forward_iterator It, std::sentinel_for<It> Sentinel>
+    std::size_t enqueue_bulk(It first, Sentinel last)
+        requires std::constructible_from<Mtype, std::iter_rvalue_reference_t<It>>
+    {
+        std::size_t accepted{0};
+        std::unique_lock lck{mutex};
+        for (; first != last; ++first, ++accepted) {
+            auto key = std::invoke(key_of, std::as_const(*first));
+            if (!wait_for_room(lck, key, accepted == 0 ? s_forever : s_no_wait)) { break; }
+            put(std::move(key), Mtype(std::ranges::iter_move(first)));
+        }
+        return accepted;
+    }
+
+    // Consumer side, with the same semantics as Queue.
+    std::optional<Mtype>
+    dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::unique_lock lck{mutex};
+        wait_for_head(lck, [this] { return !messages.empty(); }, s_forever);
+        return take_head_if(pred);
+    }
+
+    std::optional<Mtype>
+    try_dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::lock_guard lck{mutex};
+        return take_head_if(pred);
+    }
+
+    // A stop request on stop gives up waiting too.
+    std::optional<Mtype>
+    dequeue_wait_if(std::predicate<Mtype const &> auto const &pred,
+                    Clock::time_point deadline,
+                    std::stop_token const &stop = {}) {
+        // Runs right here if stop was already requested, hence before locking.
+        std::stop_callback const on_stop{stop, [this] {
+            { std::lock_guard lck{mutex}; }
+            head_changed.notify_all();
+        }};
+        std::unique_lock lck{mutex};
+        wait_for_head(
+            lck,
+            [this, &pred, &stop] {
+                return stop.stop_requested()
+                       || (!messages.empty() && std::invoke(pred, std::as_const(messages.front())));
+            },
+            deadline);
+        return take_head_if(pred);
+    }
+
+    std::optional<Mtype>
+    dequeue_first_if(std::predicate<Mtype const &> auto const &pred,
+                     std::size_t max_scan = std::numeric_limits<std::size_t>::max()) {
+        std::lock_guard lck{mutex};
+        auto it = messages.begin();
+        for (; it != messages.end() && max_scan > 0; ++it, --max_scan) {
+            if (std::invoke(pred, std::as_const(*it))) { return take(it); }
+        }
+        return {};
+    }
+
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t dequeue_bulk_if(OutputIt out,
+                                std::size_t max_n,
+                                std::predicate<Mtype const &> auto const &pred) {
+        std::unique_lock lck{mutex};
+        wait_for_head(lck, [this] { return !messages.empty(); }, s_forever);
+        return take_bulk(std::move(out), max_n, pred);
+    }
+
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t drain_if(OutputIt out,
+                         std::size_t max_n,
+                         std::predicate<Mtype const &> auto const &pred) {
+        std::lock_guard lck{mutex};
+        return take_bulk(std::move(out), max_n, pred);
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        std::lock_guard lck{mutex};
+        return messages.size();
+    }
+    [[nodiscard]] std::size_t max_size() const noexcept { return capacity; }
+    // How many pending messages were replaced by a newer one.
+    [[nodiscard]] std::size_t conflated() const {
+        std::lock_guard lck{mutex};
+        return replaced;
+    }
+
+private:
+    using Messages = std::list<Mtype>;
+
+    // True once key is pending or there is room for it.
+    bool wait_for_room(std::unique_lock<std::mutex> &lck,
+                       key_type const &key,
+                       Clock::time_point deadline) {
+        auto const ready = [this, &key] {
+            return messages.size() < capacity || index.contains(key);
+        };
+        if (ready()) { return true; }
+        if (deadline == s_no_wait) { return false; }
+        if (deadline == s_forever) {
+            not_full.wait(lck, ready);
+            return true;
+        }
+        return not_full.wait_until(lck, deadline, ready);
+    }
+
+    void wait_for_head(std::unique_lock<std::mutex> &lck,
+                       std::predicate auto const &ready,
+                       Clock::time_point deadline) {
+        ++consumers_waiting;
+        if (deadline == s_forever) {
+            head_changed.wait(lck, ready);
+        } else {
+            head_changed.wait_until(lck, deadline, ready);
+        }
+        --consumers_waiting;
+    }
+
+    void put(key_type &&key, Mtype &&msg) {
+        if (auto pending = index.find(key); pending != index.end()) {
+            *pending->second = std::move(msg);
+            ++replaced;
+            if (pending->second == messages.begin()) { head_updated(); }
+            return;
+        }
+        messages.push_back(std::move(msg));
+        index.emplace(std::move(key), std::prev(messages.end()));
+        if (messages.size() == 1) { head_updated(); }
+    }
+
+    std::optional<Mtype> take_head_if(std::predicate<Mtype const &> auto const &pred) {
+        if (messages.empty() || !std::invoke(pred, std::as_const(messages.front()))) { return {}; }
+        return take(messages.begin());
+    }
+
+    template <typename OutputIt>
+    std::size_t take_bulk(OutputIt out,
+                          std::size_t max_n,
+                          std::predicate<Mtype const &> auto const &pred) {
+        std::size_t taken{0};
+        for (; taken < max_n && !messages.empty()
+               && std::invoke(pred, std::as_const(messages.front()));
+             ++taken, ++out) {
+            *out = *take(messages.begin());
+        }
+        return taken;
+    }
+
+    std::optional<Mtype> take(typename Messages::iterator it) {
+        index.erase(std::invoke(key_of, std::as_const(*it)));
+        std::optional<Mtype> msg{std::move(*it)};
+        bool const was_head = it == messages.begin();
+        messages.erase(it);
+        not_full.notify_one();
+        if (was_head) { head_updated(); }
+        return msg;
+    }
+
+    // Receivers wait for a head that suits them, which one notify_one may
+    // not reach: wake them all, but only if there are any.
+    void head_updated() {
+        if (consumers_waiting > 0) { head_changed.notify_all(); }
+    }
+
+    [[no_unique_address]] KeyFn key_of;
+    std::size_t capacity;
+    mutable std::mutex mutex{};
+    Messages messages{};
+    std::unordered_map<key_type, typename Messages::iterator> index{};
+    std::size_t replaced{0};
+    std::size_t consumers_waiting{0};
+    std::condition_variable not_full{};
+    std::condition_variable head_changed{};
+    // Last, so that its thread stops before anything it enqueues into goes.
+    std::once_flag delayed_once{};
+    std::unique_ptr<DelayLine<Mtype, ConflatingQueue>> delayed{};
+};
+}  // namespace mq
+
+#endif
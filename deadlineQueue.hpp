@@ -0,0 +1,107 @@
+#ifndef DEADLINE_QUEUE
+#define DEADLINE_QUEUE
+
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <optional>
+#include <set>
+#include <tuple>
+#include <utility>
+
+namespace mq {
+
+// Message container for Mode::DEADLINE. DeadlineFn projects a message to the
+// steady_clock time point by which it must be handled; top() is the message
+// with the earliest deadline, the oldest among equals, and the queue drops
+// messages whose deadline has passed instead of serving them.
+// Messages are kept in arrival order and indexed by deadline, so front() and
+// back() still answer in arrival order and the queue can switch modes without
+// reordering anything. Every operation is O(log n).
+template <std::movable Mtype, typename DeadlineFn>
+    requires std::regular_invocable<DeadlineFn const &, Mtype const &>
+             && std::convertible_to<std::invoke_result_t<DeadlineFn const &, Mtype const &>,
+                                    std::chrono::steady_clock::time_point>
+class DeadlineQueue {
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Clock::time_point deadline;
+        std::uint64_t seq;
+        Mtype msg;
+    };
+    using Arrivals = std::list<Entry>;
+    using Handle = typename Arrivals::iterator;
+
+    struct Earlier {
+        bool operator()(Handle a, Handle b) const {
+            return std::tie(a->deadline, a->seq) < std::tie(b->deadline, b->seq);
+        }
+    };
+
+public:
+    using value_type = Mtype;
+
+    explicit DeadlineQueue(DeadlineFn deadline_of_ = {})
+        : deadline_of{std::move(deadline_of_)} {}
+    // by_deadline points into arrivals, which a copy would not carry along.
+    DeadlineQueue(DeadlineQueue const &) = delete;
+    DeadlineQueue(DeadlineQueue &&) noexcept = default;
+    DeadlineQueue &operator=(DeadlineQueue const &) = delete;
+    DeadlineQueue &operator=(DeadlineQueue &&) noexcept = default;
+    ~DeadlineQueue() = default;
+
+    void push_back(Mtype &&msg) {
+        Clock::time_point const deadline = std::invoke(deadline_of, std::as_const(msg));
+        arrivals.push_back(Entry{deadline, next_seq++, std::move(msg)});
+        by_deadline.insert(std::prev(arrivals.end()));
+    }
+
+    // Earliest deadline, the oldest among equals.
+    Mtype &top() { return (*by_deadline.begin())->msg; }
+    void pop_top() { erase(*by_deadline.begin()); }
+    [[nodiscard]] Clock::time_point top_deadline() const {
+        return (*by_deadline.begin())->deadline;
+    }
+
+    Mtype &front() { return arrivals.front().msg; }
+    void pop_front() { erase(arrivals.begin()); }
+
+    Mtype &back() { return arrivals.back().msg; }
+    void pop_back() { erase(std::prev(arrivals.end())); }
+
+    // Selective receive in deadline order.
+    template <typename Pred>
+    std::optional<Mtype> extract_top_if(Pred const &pred, std::size_t max_scan) {
+        for (auto it = by_deadline.begin(); it != by_deadline.end() && max_scan > 0; ++it, --max_scan) {
+            if (std::invoke(pred, std::as_const((*it)->msg))) {
+                auto const handle = *it;
+                std::optional<Mtype> msg{std::move(handle->msg)};
+                by_deadline.erase(it);
+                arrivals.erase(handle);
+                return msg;
+            }
+        }
+        return {};
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return arrivals.size(); }
+    [[nodiscard]] bool empty() const noexcept { return arrivals.empty(); }
+
+private:
+    void erase(Handle handle) {
+        by_deadline.erase(handle);
+        arrivals.erase(handle);
+    }
+
+    [[no_unique_address]] DeadlineFn deadline_of;
+    Arrivals arrivals{};
+    std::set<Handle, Earlier> by_deadline{};
+    std::uint64_t next_seq{0};
+};
+}  // namespace mq
+
+#endif
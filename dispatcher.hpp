@@ -0,0 +1,116 @@
+#ifndef DISPATCHER
+#define DISPATCHER
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "messageQueue.hpp"
+
+namespace mq {
+
+// Calls handlers on messages as they arrive, instead of receivers polling the
+// queue. Each subscription pairs a predicate with a handler. A pool of worker
+// threads sleeps on the queue as blocked receivers, so a new head is handed
+// straight to an idle worker. The message is then moved to the handler of the
+// first subscription, in subscription order, that accepts it.
+// The workers take every message: one that no subscription accepts goes to
+// the unmatched handler if one is set, and is dropped otherwise, so it never
+// holds up the messages behind it. unmatched_count() tells how many there
+// were. Other receivers of the same queue therefore compete with the workers
+// for every message.
+// Handlers run concurrently on different workers, the same handler included.
+template <std::movable Mtype, typename QueueType = Queue<Mtype>>
+class Dispatcher {
+public:
+    using value_type = Mtype;
+    using Handler = std::function<void(Mtype &&)>;
+
+    explicit Dispatcher(QueueType &queue_,
+                        std::size_t worker_count = std::max(std::thread::hardware_concurrency(), 1U))
+        : queue{queue_}
+        , count{std::max(worker_count, std::size_t{1})} {}
+    Dispatcher(Dispatcher const &) = delete;
+    Dispatcher(Dispatcher &&) = delete;
+    Dispatcher &operator=(Dispatcher const &) = delete;
+    Dispatcher &operator=(Dispatcher &&) = delete;
+    ~Dispatcher() { stop(); }
+
+    // Subscriptions are fixed once the workers run: make them all before
+    // start().
+    template <std::predicate<Mtype const &> Pred, std::invocable<Mtype &&> H>
+    void subscribe(Pred pred, H handler) {
+        subscriptions.push_back(Subscription{std::move(pred), std::move(handler)});
+    }
+
+    // Dead-letter handler for the messages no subscription accepts. Same
+    // rules as subscribe().
+    template <std::invocable<Mtype &&> H>
+    void on_unmatched(H handler) {
+        unmatched = std::move(handler);
+    }
+
+    void start() {
+        for (std::size_t i = workers.size(); i < count; ++i) {
+            workers.emplace_back([this](std::stop_token stop) { run(stop); });
+        }
+    }
+
+    // Lets the handlers already running finish and joins the workers.
+    // Messages still queued are left in the queue. Called on destruction.
+    void stop() {
+        for (auto &worker : workers) { worker.request_stop(); }
+        workers.clear();
+    }
+
+    [[nodiscard]] std::size_t worker_count() const noexcept { return count; }
+    // Messages no subscription accepted so far.
+    [[nodiscard]] std::size_t unmatched_count() const noexcept {
+        return unmatched_total.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Subscription {
+        std::function<bool(Mtype const &)> accepts;
+        Handler handler;
+    };
+
+    [[nodiscard]] Subscription const *subscriber(Mtype const &msg) const {
+        auto const it = std::ranges::find_if(subscriptions, [&msg](Subscription const &sub) {
+            return sub.accepts(msg);
+        });
+        return it != subscriptions.end() ? &*it : nullptr;
+    }
+
+    void run(std::stop_token const &stop) {
+        BlockingReceiver<Mtype, QueueType> receiver{queue};
+        while (auto msg = receiver.dequeue(stop)) {
+            if (auto const *sub = subscriber(*msg)) {
+                sub->handler(std::move(*msg));
+                continue;
+            }
+            unmatched_total.fetch_add(1, std::memory_order_relaxed);
+            if (unmatched) { unmatched(std::move(*msg)); }
+        }
+    }
+
+    QueueType &queue;  // NOLINT
+    std::size_t count;
+    std::vector<Subscription> subscriptions{};
+    Handler unmatched{};
+    std::atomic<std::size_t> unmatched_total{0};
+    std::vector<std::jthread> workers{};
+};
+template <typename QueueType>
+Dispatcher(QueueType &) -> Dispatcher<typename QueueType::value_type, QueueType>;
+template <typename QueueType>
+Dispatcher(QueueType &, std::size_t) -> Dispatcher<typename QueueType::value_type, QueueType>;
+}  // namespace mq
+
+#endif
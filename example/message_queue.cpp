@@ -5,6 +5,7 @@
 
 */
 
+#include "../dispatcher.hpp"
 #include "../messageQueue.hpp"
 #include <algorithm>
 #include <array>
@@ -59,68 +60,35 @@ std::ostream &operator<<(std::ostream &os, Action const &action) {
     return os;
 }
 
+// Handles the actions it supports, as a subscription of the dispatcher. It
+// may run on several worker threads at once.
+template <std::size_t N>
 class ListenerTask {
-    RandomElementGetter r{5, 1};  // NOLINT
-    mq::Queue<Action> &q;  // NOLINT
+    int id;
+    int min_seconds;
+    int max_seconds;
+    std::array<Action, N> supported;
 
 public:
-    explicit ListenerTask(mq::Queue<Action> &queue)
-        : q{queue} {
-    }
-    void operator()() {
-        mq::Receiver receiver{q};
-        std::array supported{
-            Action::ACTION_1,
-            Action::ACTION_2,
-            Action::ACTION_3,
-        };
-        while (true) {
-            auto m = receiver.dequeue_if([&supported](Action const &a) {
-                return std::ranges::find(supported, a) != std::ranges::end(supported);
-            });
-            if (m) {
-                std::cout << "ListenerTask "
-                          << 1
-                          << " received "
-                          << m.value()
-                          << '\n';
-            }
-            // Simulate some time-consuming task.
-            std::this_thread::sleep_for(seconds(r.get()));
-        }
+    ListenerTask(int id_, int min_seconds_, int max_seconds_, std::array<Action, N> const &supported_)
+        : id{id_}
+        , min_seconds{min_seconds_}
+        , max_seconds{max_seconds_}
+        , supported{supported_} {
     }
-};
-
-class ListenerTaskTwo {
-    RandomElementGetter r{6, 3};  // NOLINT
-    mq::Queue<Action> &q;  // NOLINT;
-
-public:
-    explicit ListenerTaskTwo(mq::Queue<Action> &queue)
-        : q{queue} {
+    [[nodiscard]] bool supports(Action const &a) const {
+        return std::ranges::find(supported, a) != std::ranges::end(supported);
     }
-    void operator()() {
-        mq::Receiver receiver{q};
-        std::array supported{
-            Action::ACTION_4,
-            Action::ACTION_5,
-            Action::ACTION_6,
-            Action::ACTION_7,
-        };
-        while (true) {
-            auto m = receiver.dequeue_if([&supported](Action const &a) {
-                return std::ranges::find(supported, a) != std::ranges::end(supported);
-            });
-            if (m) {
-                std::cout << "ListenerTask "
-                          << 2
-                          << " received "
-                          << m.value()
-                          << '\n';
-            }
-            // Simulate some time-consuming task.
-            std::this_thread::sleep_for(seconds(r.get()));
-        }
+    void operator()(Action &&m) const {
+        thread_local std::mt19937 gen{std::random_device{}()};
+        std::uniform_int_distribution<> dis{min_seconds, max_seconds};
+        std::cout << "ListenerTask "
+                  << id
+                  << " received "
+                  << m
+                  << '\n';
+        // Simulate some time-consuming task.
+        std::this_thread::sleep_for(seconds(dis(gen)));
     }
 };
 
@@ -156,10 +124,22 @@ public:
 int main() {
     mq::Queue queue{std::deque<Action>{}, 100};  // NOLINT
     ProducerTask producer_task{queue};
-    ListenerTask listener_task{queue};
-    ListenerTaskTwo listener_task2{queue};
+    ListenerTask const listener_task{1, 1, 5, std::array{
+        Action::ACTION_1,
+        Action::ACTION_2,
+        Action::ACTION_3,
+    }};
+    ListenerTask const listener_task2{2, 3, 6, std::array{
+        Action::ACTION_4,
+        Action::ACTION_5,
+        Action::ACTION_6,
+        Action::ACTION_7,
+    }};
+
+    mq::Dispatcher dispatcher{queue, 2};
+    dispatcher.subscribe([&](Action const &a) { return listener_task.supports(a); }, listener_task);
+    dispatcher.subscribe([&](Action const &a) { return listener_task2.supports(a); }, listener_task2);
+    dispatcher.start();
 
     std::jthread producer_thread{std::ref(producer_task)};
-    std::jthread listener_thread{std::ref(listener_task)};
-    std::jthread listener2_thread{std::ref(listener_task2)};
 }
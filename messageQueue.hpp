@@ -1,23 +1,36 @@
 #ifndef MESSAGE_QUEUE
 #define MESSAGE_QUEUE
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <concepts>
+#include <condition_variable>
+#include <coroutine>
 #include <functional>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <ranges>
+#include <stop_token>
+#include <thread>
 #include <type_traits>
 #include <utility>
 
+#include <cassert>
+
 #ifdef DEBUG
 #include <iostream>
 #endif
 
+#include "ringBuffer.hpp"
 #include "synchronizer.hpp"
+#include "timerWheel.hpp"
 
 // TODO:
-// 1. Blocking receiver with condition_variable
-// 2. Use only message references and pointers? (could use hierarchies of
+// 1. Use only message references and pointers? (could use hierarchies of
 // messages in one queue)
 //    queue of unique_ptr(s)
 namespace mq {
@@ -25,6 +38,27 @@ namespace mq {
 enum class Mode {
     FIFO,
     LIFO,
+    PRIORITY,
+    DEADLINE,
+};
+
+// What enqueue does when the queue is full, chosen at construction.
+// BLOCK waits for room. The other three never wait: REJECT returns false and
+// leaves the message with the caller, DROP_NEWEST discards the new message
+// but still reports success, and DROP_OLDEST evicts the oldest message to
+// make room, like a ring that overwrites itself.
+enum class Overflow {
+    BLOCK,
+    DROP_NEWEST,
+    DROP_OLDEST,
+    REJECT,
+};
+
+// How many messages a queue has lost to its Overflow policy.
+struct OverflowCounters {
+    std::size_t dropped_newest{0};
+    std::size_t dropped_oldest{0};
+    std::size_t rejected{0};
 };
 
 template <typename Q>
@@ -39,14 +73,152 @@ concept ValidQueue = requires(Q q) {
     { q.empty() } -> std::convertible_to<bool>;
 };
 
+// Node based containers, such as std::list, that selective receive can walk
+// and erase from the middle of in constant time. Splicing is what tells them
+// from std::deque, whose erase from the middle is linear.
+template <typename Q>
+concept ScannableQueue = ValidQueue<Q> && std::ranges::bidirectional_range<Q>
+                         && requires(Q q, Q other) {
+                                q.erase(q.begin());
+                                q.splice(q.end(), other);
+                            };
+
+// Non-owning reference to a predicate on messages, for the places where its
+// type has to be erased.
+template <typename Mtype>
+class PredicateRef {
+public:
+    template <std::predicate<Mtype const &> Pred>
+    explicit PredicateRef(Pred const &pred_)
+        : pred{&pred_}
+        , call{[](void const *p, Mtype const &msg) -> bool {
+            return std::invoke(*static_cast<Pred const *>(p), msg);
+        }} {}
+
+    bool operator()(Mtype const &msg) const { return call(pred, msg); }
+
+private:
+    void const *pred;
+    bool (*call)(void const *, Mtype const &);
+};
+
+// Removes the first element accepted by pred among the first max_scan ones,
+// walking from the front or from the back. Other than ScannableQueue ones,
+// containers only have their first element checked.
+template <bool FromBack, ValidQueue QueueType, typename Pred>
+std::optional<typename QueueType::value_type>
+extract_first_if(QueueType &messq, Pred const &pred, std::size_t max_scan) {
+    using value_type = typename QueueType::value_type;
+    if constexpr (ScannableQueue<QueueType>) {
+        auto const take = [&](auto it, auto last) -> std::optional<value_type> {
+            for (; it != last && max_scan > 0; ++it, --max_scan) {
+                if (std::invoke(pred, std::as_const(*it))) {
+                    std::optional<value_type> msg{std::move(*it)};
+                    if constexpr (FromBack) {
+                        messq.erase(std::next(it).base());
+                    } else {
+                        messq.erase(it);
+                    }
+                    return msg;
+                }
+            }
+            return {};
+        };
+        if constexpr (FromBack) {
+            return take(messq.rbegin(), messq.rend());
+        } else {
+            return take(messq.begin(), messq.end());
+        }
+    } else {
+        if (messq.empty() || max_scan == 0) { return {}; }
+        auto &head = FromBack ? messq.back() : messq.front();
+        if (!std::invoke(pred, std::as_const(head))) { return {}; }
+        std::optional<value_type> msg{std::move(head)};
+        if constexpr (FromBack) {
+            messq.pop_back();
+        } else {
+            messq.pop_front();
+        }
+        return msg;
+    }
+}
+
+// Containers that know the priority of their messages, such as
+// PriorityLanes. Any other ValidQueue ranks all messages the same, so
+// PRIORITY mode serves it in FIFO order.
+template <typename Q>
+concept PrioritizedQueue = ValidQueue<Q> && requires(Q q) {
+    { q.top() } -> std::same_as<typename Q::value_type &>;
+    q.pop_top();
+};
+
+template <ValidQueue QueueType>
+auto &top_of(QueueType &messq) {
+    if constexpr (PrioritizedQueue<QueueType>) {
+        return messq.top();
+    } else {
+        return messq.front();
+    }
+}
+
+template <ValidQueue QueueType>
+void pop_top_of(QueueType &messq) {
+    if constexpr (PrioritizedQueue<QueueType>) {
+        messq.pop_top();
+    } else {
+        messq.pop_front();
+    }
+}
+
+// Containers whose messages carry a deadline, such as DeadlineQueue: top() is
+// the message with the earliest one. Messages in any other ValidQueue never
+// expire.
+template <typename Q>
+concept ExpiringQueue = PrioritizedQueue<Q> && requires(Q q) {
+    { q.top_deadline() } -> std::convertible_to<std::chrono::steady_clock::time_point>;
+};
+
+template <ValidQueue QueueType>
+std::chrono::steady_clock::time_point top_deadline_of(QueueType &messq) {
+    if constexpr (ExpiringQueue<QueueType>) {
+        return messq.top_deadline();
+    } else {
+        return std::chrono::steady_clock::time_point::max();
+    }
+}
+
+// Selective receive in priority order.
+template <ValidQueue QueueType, typename Pred>
+std::optional<typename QueueType::value_type>
+extract_top_if(QueueType &messq, Pred const &pred, std::size_t max_scan) {
+    if constexpr (requires { messq.extract_top_if(pred, max_scan); }) {
+        return messq.extract_top_if(pred, max_scan);
+    } else if constexpr (PrioritizedQueue<QueueType>) {
+        if (messq.empty() || max_scan == 0 || !std::invoke(pred, std::as_const(messq.top()))) {
+            return {};
+        }
+        std::optional<typename QueueType::value_type> msg{std::move(messq.top())};
+        messq.pop_top();
+        return msg;
+    } else {
+        return extract_first_if<false>(messq, pred, max_scan);
+    }
+}
+
 template <std::movable Mtype>
 class BaseQueue {
 public:
     virtual void pop_front() = 0;
     virtual void pop_back() = 0;
-    virtual void push(Mtype const &msg) = 0;
+    virtual void push(Mtype &&msg) = 0;
     virtual Mtype &back() = 0;
     virtual Mtype &front() = 0;
+    virtual Mtype &top() = 0;
+    virtual void pop_top() = 0;
+    [[nodiscard]] virtual std::chrono::steady_clock::time_point top_deadline() = 0;
+    // Scans in the order mode serves messages.
+    virtual std::optional<Mtype>
+    extract_first_if(PredicateRef<Mtype> pred, std::size_t max_scan, Mode order) = 0;
     [[nodiscard]] virtual std::size_t size() const = 0;
     [[nodiscard]] virtual bool empty() const = 0;
     virtual ~BaseQueue() = default;
@@ -60,9 +232,25 @@ public:
 
     void pop_front() final { queue.pop_front(); }
     void pop_back() final { queue.pop_back(); }
-    void push(Mtype const &msg) final { queue.push_back(msg); }
+    void push(Mtype &&msg) final { queue.push_back(std::move(msg)); }
     Mtype &back() final { return queue.back(); }
     Mtype &front() final { return queue.front(); }
+    Mtype &top() final { return top_of(queue); }
+    void pop_top() final { pop_top_of(queue); }
+    std::chrono::steady_clock::time_point top_deadline() final { return top_deadline_of(queue); }
+    std::optional<Mtype>
+    extract_first_if(PredicateRef<Mtype> pred, std::size_t max_scan, Mode order) final {
+        switch (order) {
+        case Mode::FIFO:
+            return mq::extract_first_if<false>(queue, pred, max_scan);
+        case Mode::LIFO:
+            return mq::extract_first_if<true>(queue, pred, max_scan);
+        case Mode::PRIORITY:
+        case Mode::DEADLINE:
+            return mq::extract_top_if(queue, pred, max_scan);
+        }
+        return {};
+    }
     [[nodiscard]] std::size_t size() const final { return queue.size(); }
     [[nodiscard]] bool empty() const final { return queue.empty(); }
 
@@ -76,8 +264,10 @@ public:
     virtual void pop(BaseQueue<Mtype> &messq) = 0;
     [[nodiscard]] virtual Mtype const &peek(BaseQueue<Mtype> &messq) const = 0;
     [[nodiscard]] virtual Mtype move(BaseQueue<Mtype> &messq) = 0;
-    virtual void push(Mtype const &msg, BaseQueue<Mtype> &messq) {
-        messq.push(msg);
+    [[nodiscard]] virtual std::optional<Mtype>
+    take_first_if(BaseQueue<Mtype> &messq, PredicateRef<Mtype> pred, std::size_t max_scan) = 0;
+    virtual void push(Mtype &&msg, BaseQueue<Mtype> &messq) {
+        messq.push(std::move(msg));
     }
     [[nodiscard]] virtual Mode get_mode() const noexcept { return qmode; }
     virtual ~BaseQueueManipulator() = default;
@@ -99,6 +289,10 @@ public:
         return messq.front();
     }
     Mtype move(BaseQueue<Mtype> &messq) final { return std::move(messq.front()); }
+    std::optional<Mtype>
+    take_first_if(BaseQueue<Mtype> &messq, PredicateRef<Mtype> pred, std::size_t max_scan) final {
+        return messq.extract_first_if(pred, max_scan, Mode::FIFO);
+    }
 };
 
 template <std::movable Mtype>
@@ -112,42 +306,183 @@ public:
         return messq.back();
     }
     Mtype move(BaseQueue<Mtype> &messq) final { return std::move(messq.back()); }
+    std::optional<Mtype>
+    take_first_if(BaseQueue<Mtype> &messq, PredicateRef<Mtype> pred, std::size_t max_scan) final {
+        return messq.extract_first_if(pred, max_scan, Mode::LIFO);
+    }
 };
 
+// Also serves Mode::DEADLINE: a DeadlineQueue puts the earliest deadline on
+// top.
 template <std::movable Mtype>
-class Queue {
-    inline static constexpr std::size_t s_default_size{1000};
+class QueueManipulatorPriority : public BaseQueueManipulator<Mtype> {
+public:
+    explicit QueueManipulatorPriority(Mode qmode_ = Mode::PRIORITY)
+        : BaseQueueManipulator<Mtype>{qmode_} {}
+
+    void pop(BaseQueue<Mtype> &messq) final { messq.pop_top(); }
+    Mtype const &peek(BaseQueue<Mtype> &messq) const final {
+        return messq.top();
+    }
+    Mtype move(BaseQueue<Mtype> &messq) final { return std::move(messq.top()); }
+    std::optional<Mtype>
+    take_first_if(BaseQueue<Mtype> &messq, PredicateRef<Mtype> pred, std::size_t max_scan) final {
+        return messq.extract_first_if(pred, max_scan, Mode::PRIORITY);
+    }
+};
+
+// Builds the message in place when the container can do it.
+template <ValidQueue QueueType, typename... Args>
+void emplace_into(QueueType &messq, Args &&...args) {
+    if constexpr (requires { messq.emplace_back(std::forward<Args>(args)...); }) {
+        messq.emplace_back(std::forward<Args>(args)...);
+    } else {
+        messq.push_back(typename QueueType::value_type(std::forward<Args>(args)...));
+    }
+}
+
+// Compile time counterparts of the manipulators above. They work on any
+// ValidQueue directly, so every call can be inlined.
+struct Fifo {
+    template <ValidQueue QueueType>
+    static void pop(QueueType &messq) { messq.pop_front(); }
+    template <ValidQueue QueueType>
+    [[nodiscard]] static auto const &peek(QueueType &messq) { return messq.front(); }
+    template <ValidQueue QueueType>
+    [[nodiscard]] static auto move(QueueType &messq) { return std::move(messq.front()); }
+    template <ValidQueue QueueType, typename Pred>
+    [[nodiscard]] static auto
+    take_first_if(QueueType &messq, Pred const &pred, std::size_t max_scan) {
+        return extract_first_if<false>(messq, pred, max_scan);
+    }
+    template <ValidQueue QueueType>
+    static void push(typename QueueType::value_type &&msg, QueueType &messq) {
+        messq.push_back(std::move(msg));
+    }
+    template <ValidQueue QueueType, typename... Args>
+    static void emplace(QueueType &messq, Args &&...args) {
+        emplace_into(messq, std::forward<Args>(args)...);
+    }
+    [[nodiscard]] static constexpr Mode get_mode() noexcept { return Mode::FIFO; }
+};
+
+struct Lifo {
+    template <ValidQueue QueueType>
+    static void pop(QueueType &messq) { messq.pop_back(); }
+    template <ValidQueue QueueType>
+    [[nodiscard]] static auto const &peek(QueueType &messq) { return messq.back(); }
+    template <ValidQueue QueueType>
+    [[nodiscard]] static auto move(QueueType &messq) { return std::move(messq.back()); }
+    template <ValidQueue QueueType, typename Pred>
+    [[nodiscard]] static auto
+    take_first_if(QueueType &messq, Pred const &pred, std::size_t max_scan) {
+        return extract_first_if<true>(messq, pred, max_scan);
+    }
+    template <ValidQueue QueueType>
+    static void push(typename QueueType::value_type &&msg, QueueType &messq) {
+        messq.push_back(std::move(msg));
+    }
+    template <ValidQueue QueueType, typename... Args>
+    static void emplace(QueueType &messq, Args &&...args) {
+        emplace_into(messq, std::forward<Args>(args)...);
+    }
+    [[nodiscard]] static constexpr Mode get_mode() noexcept { return Mode::LIFO; }
+};
 
+// Highest priority first, the oldest among equals. Meant for a
+// PrioritizedQueue such as PriorityLanes; other containers are served FIFO.
+struct Priority {
+    template <ValidQueue QueueType>
+    static void pop(QueueType &messq) { pop_top_of(messq); }
+    template <ValidQueue QueueType>
+    [[nodiscard]] static auto const &peek(QueueType &messq) { return top_of(messq); }
+    template <ValidQueue QueueType>
+    [[nodiscard]] static auto move(QueueType &messq) { return std::move(top_of(messq)); }
+    template <ValidQueue QueueType, typename Pred>
+    [[nodiscard]] static auto
+    take_first_if(QueueType &messq, Pred const &pred, std::size_t max_scan) {
+        return extract_top_if(messq, pred, max_scan);
+    }
+    template <ValidQueue QueueType>
+    static void push(typename QueueType::value_type &&msg, QueueType &messq) {
+        messq.push_back(std::move(msg));
+    }
+    template <ValidQueue QueueType, typename... Args>
+    static void emplace(QueueType &messq, Args &&...args) {
+        emplace_into(messq, std::forward<Args>(args)...);
+    }
+    [[nodiscard]] static constexpr Mode get_mode() noexcept { return Mode::PRIORITY; }
+};
+
+// Earliest deadline first, for a DeadlineQueue: the queue drops messages
+// whose deadline has passed instead of handing them out. Other containers
+// are served as with Priority, and nothing in them expires.
+struct Deadline : Priority {
+    [[nodiscard]] static constexpr Mode get_mode() noexcept { return Mode::DEADLINE; }
+};
+
+// Owns any ValidQueue behind a BaseQueue, so that the container type does not
+// show up in the type of the Queue.
+template <std::movable Mtype>
+class AnyQueue {
 public:
+    using value_type = Mtype;
+
     template <ValidQueue QueueType>
-    explicit Queue(QueueType &&msg_queue_, std::size_t max_size_ = s_default_size)  // NOLINT
+    explicit AnyQueue(QueueType &&msg_queue_)  // NOLINT
         requires std::is_rvalue_reference_v<decltype(msg_queue_)>
         : msg_queue{std::make_unique<
             DerivedQueue<Mtype, std::remove_cvref_t<QueueType>>>(
-            std::move(msg_queue_))}  // NOLINT
-        , max_size{max_size_}
-        , count_full{max_size_, 0}
-        , count_empty{max_size_, max_size_} {}
+            std::move(msg_queue_))} {}  // NOLINT
 
-    std::optional<Mtype>
-    dequeue_if(std::predicate<Mtype const &> auto const &pred) {
-        synch::Synchronizer s{count_full, count_empty, mutex};
-        if (msg_queue->empty()) { return {}; }
-        if (std::invoke(pred, queue_manipulator->peek(*msg_queue))) {
-            auto msg = queue_manipulator->move(*msg_queue);
-            pop();
-            return {msg};
-        }
-        return {};
+    void pop_front() { msg_queue->pop_front(); }
+    void pop_back() { msg_queue->pop_back(); }
+    void push_back(Mtype &&msg) { msg_queue->push(std::move(msg)); }
+    Mtype &back() { return msg_queue->back(); }
+    Mtype &front() { return msg_queue->front(); }
+    Mtype &top() { return msg_queue->top(); }
+    void pop_top() { msg_queue->pop_top(); }
+    [[nodiscard]] std::chrono::steady_clock::time_point top_deadline() {
+        return msg_queue->top_deadline();
     }
+    [[nodiscard]] std::size_t size() const { return msg_queue->size(); }
+    [[nodiscard]] bool empty() const { return msg_queue->empty(); }
+    [[nodiscard]] BaseQueue<Mtype> &base() { return *msg_queue; }
 
-    bool enqueue(Mtype &&msg) {
-        synch::Synchronizer s{count_empty, count_full, mutex};
-        return push(std::move(msg));
-    }
+private:
+    std::unique_ptr<BaseQueue<Mtype>> msg_queue;
+};
 
+// Type-erased policy which can be switched at runtime through the
+// manipulators. Starts in LIFO mode.
+template <std::movable Mtype>
+class DynamicMode {
+public:
+    void pop(AnyQueue<Mtype> &messq) { queue_manipulator->pop(messq.base()); }
+    [[nodiscard]] Mtype const &peek(AnyQueue<Mtype> &messq) const {
+        return queue_manipulator->peek(messq.base());
+    }
+    [[nodiscard]] Mtype move(AnyQueue<Mtype> &messq) {
+        return queue_manipulator->move(messq.base());
+    }
+    template <typename Pred>
+    [[nodiscard]] std::optional<Mtype>
+    take_first_if(AnyQueue<Mtype> &messq, Pred const &pred, std::size_t max_scan) {
+        return queue_manipulator->take_first_if(messq.base(), PredicateRef<Mtype>{pred}, max_scan);
+    }
+    void push(Mtype &&msg, AnyQueue<Mtype> &messq) {
+        queue_manipulator->push(std::move(msg), messq.base());
+    }
+    // The container is hidden behind BaseQueue, so the message is built here
+    // and moved in.
+    template <typename... Args>
+    void emplace(AnyQueue<Mtype> &messq, Args &&...args) {
+        push(Mtype(std::forward<Args>(args)...), messq);
+    }
+    [[nodiscard]] Mode get_mode() const noexcept {
+        return queue_manipulator->get_mode();
+    }
     void set_mode(Mode new_mode) {
-        std::lock_guard lck{mutex};
         switch (new_mode) {
         case Mode::FIFO:
             queue_manipulator.reset(new QueueManipulatorFIFO<Mtype>{});
@@ -155,71 +490,1134 @@ public:
         case Mode::LIFO:
             queue_manipulator.reset(new QueueManipulatorLIFO<Mtype>{});
             break;
+        case Mode::PRIORITY:
+            queue_manipulator.reset(new QueueManipulatorPriority<Mtype>{});
+            break;
+        case Mode::DEADLINE:
+            queue_manipulator.reset(new QueueManipulatorPriority<Mtype>{Mode::DEADLINE});
+            break;
         }
     }
 
+private:
+    std::unique_ptr<BaseQueueManipulator<Mtype>> queue_manipulator{
+        new QueueManipulatorLIFO<Mtype>{}};
+};
+
+template <typename Policy, typename QueueType>
+concept QueuePolicy = requires(Policy p, QueueType q, typename QueueType::value_type msg) {
+    p.pop(q);
+    p.peek(q);
+    { p.move(q) } -> std::same_as<typename QueueType::value_type>;
+    p.push(std::move(msg), q);
+    { p.get_mode() } -> std::same_as<Mode>;
+};
+
+// Queue<Mtype> is the runtime configurable queue: any ValidQueue container,
+// and a mode that can be changed with set_mode. Naming a Policy and a Storage
+// fixes both at compile time instead, e.g. Queue<Msg, Fifo, std::deque<Msg>>,
+// which removes every virtual call from the enqueue/dequeue path.
+template <std::movable Mtype,
+          typename Policy = DynamicMode<Mtype>,
+          typename Storage = AnyQueue<Mtype>>
+class Queue {
+    static_assert(ValidQueue<Storage>);
+    static_assert(QueuePolicy<Policy, Storage>);
+
+    inline static constexpr std::size_t s_default_size{1000};
+
+    // A coroutine parked in async_dequeue_if or async_enqueue, to be resumed
+    // once the operation that served it has let go of the mutex.
+    struct Suspended {
+        std::coroutine_handle<> handle{};
+        Suspended *next_ready{nullptr};
+    };
+
+    // A receiver blocked in dequeue_wait_if, or a coroutine awaiting
+    // async_dequeue_if. Lives on that receiver's stack or in the coroutine
+    // frame, and is only touched with the mutex held.
+    struct Waiter : Suspended {
+        template <typename Pred>
+        explicit Waiter(Pred const &pred_)
+            : accepts{pred_} {}
+
+        PredicateRef<Mtype> accepts;
+        std::optional<Mtype> msg{};
+        std::condition_variable cv{};
+        Waiter *prev{nullptr};
+        Waiter *next{nullptr};
+    };
+
+    // A coroutine awaiting async_enqueue on a full queue.
+    struct Sender : Suspended {
+        explicit Sender(Mtype &msg_)
+            : msg{&msg_} {}
+
+        Mtype *msg;
+        bool accepted{false};
+        Sender *next{nullptr};
+    };
+
+public:
+    using value_type = Mtype;
+
+    // Awaitables for coroutines. They live in the awaiting coroutine's frame,
+    // waiter included, so suspending allocates nothing, and a coroutine is
+    // resumed by the thread that serves it, right after that thread unlocks
+    // the queue. A coroutine must not be destroyed while suspended on one.
+    template <typename Pred>
+    class DequeueAwaiter {
+    public:
+        DequeueAwaiter(Queue &queue_, Pred pred_)
+            : queue{queue_}
+            , pred{std::move(pred_)} {}
+        DequeueAwaiter(DequeueAwaiter const &) = delete;
+        DequeueAwaiter(DequeueAwaiter &&) = delete;
+        DequeueAwaiter &operator=(DequeueAwaiter const &) = delete;
+        DequeueAwaiter &operator=(DequeueAwaiter &&) = delete;
+        ~DequeueAwaiter() = default;
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle) { return queue.park(waiter, handle); }
+        Mtype await_resume() { return std::move(*waiter.msg); }
+
+    private:
+        Queue &queue;  // NOLINT
+        Pred pred;
+        Waiter waiter{pred};
+    };
+
+    class EnqueueAwaiter {
+    public:
+        EnqueueAwaiter(Queue &queue_, Mtype &&msg_)
+            : queue{queue_}
+            , msg{std::move(msg_)} {}
+        EnqueueAwaiter(EnqueueAwaiter const &) = delete;
+        EnqueueAwaiter(EnqueueAwaiter &&) = delete;
+        EnqueueAwaiter &operator=(EnqueueAwaiter const &) = delete;
+        EnqueueAwaiter &operator=(EnqueueAwaiter &&) = delete;
+        ~EnqueueAwaiter() = default;
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle) { return queue.park(sender, handle); }
+        // False only if the Overflow policy turned the message away.
+        [[nodiscard]] bool await_resume() const noexcept { return sender.accepted; }
+
+    private:
+        Queue &queue;  // NOLINT
+        Mtype msg;
+        Sender sender{msg};
+    };
+
+    // max_size is clamped to sem::Semaphore::s_max_slots, 2^32 - 1.
+    template <ValidQueue QueueType>
+    explicit Queue(QueueType &&msg_queue_,  // NOLINT
+                   std::size_t max_size_ = s_default_size,
+                   Overflow overflow_ = Overflow::BLOCK)
+        requires std::is_rvalue_reference_v<decltype(msg_queue_)>
+                 && std::constructible_from<Storage, QueueType &&>
+        : msg_queue{std::move(msg_queue_)}  // NOLINT
+        , max_size{std::min(max_size_, sem::Semaphore::s_max_slots)}
+        , overflow{overflow_}
+        , count_full{max_size, 0}
+        , count_empty{max_size, max_size} {}
+
+    std::optional<Mtype>
+    dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        Resumer resumer{*this};
+        synch::Synchronizer s{count_full, count_empty, mutex};
+        return take_head_if(s, pred);
+    }
+
+    // Returns nothing right away if the queue is empty: an empty queue costs
+    // a single atomic load and never touches the mutex.
+    std::optional<Mtype>
+    try_dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        Resumer resumer{*this};
+        synch::Synchronizer s{count_full, count_empty, mutex, std::try_to_lock};
+        if (!s.owns_slot()) { return {}; }
+        return take_head_if(s, pred);
+    }
+
+    // Selective receive: removes the first message accepted by pred, looking
+    // at no more than max_scan messages from the head, so that a message
+    // meant for someone else does not block this receiver.
+    std::optional<Mtype>
+    dequeue_first_if(std::predicate<Mtype const &> auto const &pred,
+                     std::size_t max_scan = std::numeric_limits<std::size_t>::max()) {
+        Resumer resumer{*this};
+        synch::Synchronizer s{count_full, count_empty, mutex};
+        if (!skip_expired()) { return {}; }
+        auto msg = policy.take_first_if(msg_queue, pred, max_scan);
+        if (msg) {
+            hand_off();
+        } else {
+            rejected(s);
+        }
+        return msg;
+    }
+
+    // Waits for at least one message, then moves up to max_n messages to out
+    // under a single lock, stopping at the first head rejected by pred.
+    // Returns how many messages were moved.
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t dequeue_bulk_if(OutputIt out,
+                                std::size_t max_n,
+                                std::predicate<Mtype const &> auto const &pred) {
+        Resumer resumer{*this};
+        return take_bulk(std::move(out), count_full.acquire_up_to(max_n), pred);
+    }
+
+    // Same as dequeue_bulk_if, but returns 0 instead of waiting when the
+    // queue is empty.
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t drain_if(OutputIt out,
+                         std::size_t max_n,
+                         std::predicate<Mtype const &> auto const &pred) {
+        Resumer resumer{*this};
+        return take_bulk(std::move(out), count_full.try_acquire_up_to(max_n), pred);
+    }
+
+    // Parks the caller until the head element satisfies pred or the deadline
+    // expires. Each blocked receiver sleeps on its own condition variable and
+    // the thread that exposes a matching head moves the message straight to
+    // it, so exactly one receiver is woken per message. A stop request on
+    // stop gives up waiting too; a message handed over first still wins.
+    std::optional<Mtype>
+    dequeue_wait_if(std::predicate<Mtype const &> auto const &pred,
+                    std::chrono::steady_clock::time_point deadline,
+                    std::stop_token stop = {}) {
+        Resumer resumer{*this};
+        Waiter self{pred};
+        bool stopped{false};
+        // Runs right here if stop was already requested, hence before locking.
+        std::stop_callback const on_stop{stop, [this, &self, &stopped] {
+            std::lock_guard lck{mutex};
+            stopped = true;
+            self.cv.notify_one();
+        }};
+        std::unique_lock lck{mutex};
+        if (stopped || serve_now(self, lck)) { return std::move(self.msg); }
+        link(self);
+        auto const done = [&self, &stopped] { return self.msg.has_value() || stopped; };
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            self.cv.wait(lck, done);
+        } else {
+            self.cv.wait_until(lck, deadline, done);
+        }
+        if (!self.msg) { unlink(self); }
+        return std::move(self.msg);
+    }
+
+    // co_await suspends the calling coroutine until the head satisfies pred,
+    // without blocking its thread, and yields the message.
+    template <std::predicate<Mtype const &> Pred>
+    DequeueAwaiter<Pred> async_dequeue_if(Pred pred) {
+        return DequeueAwaiter<Pred>{*this, std::move(pred)};
+    }
+
+    // co_await suspends the calling coroutine while the queue is full. Other
+    // Overflow policies than BLOCK never suspend.
+    EnqueueAwaiter async_enqueue(Mtype &&msg) { return EnqueueAwaiter{*this, std::move(msg)}; }
+
+    // The enqueue calls below only wait, or fail for lack of time, with
+    // Overflow::BLOCK. Any other policy resolves a full queue right away.
+    bool enqueue(Mtype &&msg) {
+        Resumer resumer{*this};
+        if (overflow != Overflow::BLOCK) { return enqueue_lossy(pusher(msg)); }
+        synch::Synchronizer s{count_empty, count_full, mutex};
+        return push_locked(s, std::move(msg));
+    }
+
+    // Returns false right away if the queue is full, leaving msg untouched.
+    bool try_enqueue(Mtype &&msg) {
+        Resumer resumer{*this};
+        if (overflow != Overflow::BLOCK) { return enqueue_lossy(pusher(msg)); }
+        synch::Synchronizer s{count_empty, count_full, mutex, std::try_to_lock};
+        return s.owns_slot() && push_locked(s, std::move(msg));
+    }
+
+    // Returns false if the queue is still full at deadline, leaving msg
+    // untouched.
+    bool enqueue_until(Mtype &&msg, std::chrono::steady_clock::time_point deadline) {
+        Resumer resumer{*this};
+        if (overflow != Overflow::BLOCK) { return enqueue_lossy(pusher(msg)); }
+        synch::Synchronizer s{count_empty, count_full, mutex, deadline};
+        return s.owns_slot() && push_locked(s, std::move(msg));
+    }
+
+    // Keeps msg out of the queue until due, then enqueues it from a timer
+    // thread started on first use. Until then it takes no room and no
+    // receiver can see it.
+    void enqueue_at(Mtype &&msg, std::chrono::steady_clock::time_point due) {
+        std::call_once(delayed_once, [this] {
+            delayed = std::make_unique<DelayLine<Mtype, Queue>>(*this, overflow == Overflow::BLOCK);
+        });
+        delayed->schedule(std::move(msg), due);
+    }
+
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        Resumer resumer{*this};
+        if (overflow != Overflow::BLOCK) {
+            return enqueue_lossy(emplacer(std::forward<Args>(args)...));
+        }
+        synch::Synchronizer s{count_empty, count_full, mutex};
+        return emplace_locked(s, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        Resumer resumer{*this};
+        if (overflow != Overflow::BLOCK) {
+            return enqueue_lossy(emplacer(std::forward<Args>(args)...));
+        }
+        synch::Synchronizer s{count_empty, count_full, mutex, std::try_to_lock};
+        return s.owns_slot() && emplace_locked(s, std::forward<Args>(args)...);
+    }
+
+    // Waits for room for at least one message, then moves in as many of
+    // [first, last) as fit, taking the lock once and waking receivers once.
+    // Returns how many messages were accepted; the rest are left untouched.
+    template <std::forward_iterator It, std::sentinel_for<It> Sentinel>
+    std::size_t enqueue_bulk(It first, Sentinel last)
+        requires std::constructible_from<Mtype, std::iter_rvalue_reference_t<It>>
+    {
+        Resumer resumer{*this};
+        if (overflow != Overflow::BLOCK) {
+            std::size_t accepted{0};
+            auto const insert = [this, &first] {
+                policy.push(Mtype(std::ranges::iter_move(first)), msg_queue);
+            };
+            for (; first != last && enqueue_lossy(insert); ++first) { ++accepted; }
+            return accepted;
+        }
+        auto const wanted = static_cast<std::size_t>(std::ranges::distance(first, last));
+        auto const accepted = count_empty.acquire_up_to(wanted);
+        std::size_t handed{0};
+        {
+            std::lock_guard lck{mutex};
+            for (std::size_t i = 0; i < accepted; ++i, ++first) {
+                policy.push(Mtype(std::ranges::iter_move(first)), msg_queue);
+            }
+            drop_expired();
+            while (handed < accepted) {
+                auto *waiter = waiter_for_head();
+                if (waiter == nullptr) { break; }
+                give(*waiter);
+                ++handed;
+            }
+            check_counts();
+        }
+        count_full.release(accepted - handed);
+        count_empty.release(handed);
+        return accepted;
+    }
+
+    void set_mode(Mode new_mode)
+        requires requires(Policy p) { p.set_mode(new_mode); }
+    {
+        Resumer resumer{*this};
+        std::lock_guard lck{mutex};
+        policy.set_mode(new_mode);
+        hand_off();
+    }
+
     [[nodiscard]] Mode mode() const {
         std::lock_guard lck{mutex};
-        return queue_manipulator->get_mode();
+        return policy.get_mode();
+    }
+
+    [[nodiscard]] OverflowCounters overflow_counters() const {
+        std::lock_guard lck{mutex};
+        return counters;
+    }
+
+    // How many messages Mode::DEADLINE dropped for being past their deadline.
+    [[nodiscard]] std::size_t expired_count() const {
+        std::lock_guard lck{mutex};
+        return dropped_expired;
+    }
+
+    // Whether the semaphores agree with the container right now: neither
+    // promises more messages or more room than there are. Holds at any
+    // time, under any contention; meant for tests.
+    [[nodiscard]] bool counts_consistent() const {
+        std::lock_guard lck{mutex};
+        return counts_hold();
     }
 
 private:
-    [[nodiscard]] bool full() const { return msg_queue->size() == max_size; }
-    [[nodiscard]] bool empty() const { return msg_queue->empty(); }
-    void pop() { queue_manipulator->pop(*msg_queue); }
+    void link(Waiter &w) {
+        w.prev = waiters_tail;
+        if (waiters_tail != nullptr) {
+            waiters_tail->next = &w;
+        } else {
+            waiters_head = &w;
+        }
+        waiters_tail = &w;
+    }
+
+    void unlink(Waiter &w) {
+        (w.prev != nullptr ? w.prev->next : waiters_head) = w.next;
+        (w.next != nullptr ? w.next->prev : waiters_tail) = w.prev;
+        w.prev = w.next = nullptr;
+    }
+
+    // Oldest blocked receiver that wants the current head, if any. An expired
+    // head goes to nobody.
+    [[nodiscard]] Waiter *waiter_for_head() {
+        if (waiters_head == nullptr || msg_queue.empty() || head_expired()) { return nullptr; }
+        auto const &head = policy.peek(msg_queue);
+        for (auto *w = waiters_head; w != nullptr; w = w->next) {
+            if (w->accepts(head)) { return w; }
+        }
+        return nullptr;
+    }
+
+    // Moves the head to w. The caller accounts for the slot it frees.
+    void give(Waiter &w) {
+        w.msg.emplace(policy.move(msg_queue));
+        pop();
+        unlink(w);
+        if (w.handle) {
+            resume_later(w);
+        } else {
+            w.cv.notify_one();
+        }
+    }
+
+    // Fast path of a receiver about to park, with the mutex held: takes the
+    // head at once if w wants it and a slot of count_full is free.
+    bool serve_now(Waiter &w, std::unique_lock<std::mutex> &lck) {
+        drop_expired();
+        if (msg_queue.empty() || !w.accepts(policy.peek(msg_queue)) || !count_full.try_acquire()) {
+            return false;
+        }
+        w.msg.emplace(policy.move(msg_queue));
+        pop();
+        hand_off();
+        lck.unlock();
+        count_empty.release();
+        return true;
+    }
+
+    // await_suspend of the awaiters: false means done without suspending.
+    bool park(Waiter &w, std::coroutine_handle<> handle) {
+        Resumer resumer{*this};
+        std::unique_lock lck{mutex};
+        if (serve_now(w, lck)) { return false; }
+        w.handle = handle;
+        link(w);
+        return true;
+    }
+
+    bool park(Sender &sender, std::coroutine_handle<> handle) {
+        Resumer resumer{*this};
+        if (overflow != Overflow::BLOCK) {
+            sender.accepted = enqueue_lossy(pusher(*sender.msg));
+            return false;
+        }
+        std::lock_guard lck{mutex};
+        // Announced before the last look at count_empty, see serve_senders.
+        senders_waiting.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (senders_head == nullptr && count_empty.try_acquire()) {
+            senders_waiting.fetch_sub(1, std::memory_order_relaxed);
+            sender_pushed(sender);
+            return false;
+        }
+        sender.handle = handle;
+        (senders_tail == nullptr ? senders_head : senders_tail->next) = &sender;
+        senders_tail = &sender;
+        return true;
+    }
+
+    // Gives parked senders, oldest first, every free slot of count_empty.
+    // Runs after every operation, since most of them may free one, and then
+    // costs a single load while no sender is parked. Slots are freed by a
+    // seq_cst read-modify-write and a sender announces itself before its
+    // last try, so either it sees the slot or this load sees the sender.
+    void serve_senders() {
+        if (senders_waiting.load(std::memory_order_seq_cst) == 0) { return; }
+        std::lock_guard lck{mutex};
+        while (senders_head != nullptr && count_empty.try_acquire()) {
+            auto &sender = *senders_head;
+            senders_head = sender.next;
+            if (senders_head == nullptr) { senders_tail = nullptr; }
+            senders_waiting.fetch_sub(1, std::memory_order_relaxed);
+            sender_pushed(sender);
+            resume_later(sender);
+        }
+    }
+
+    // Called with the mutex held and a slot of count_empty taken for sender.
+    // Same as pushed, with the slot held by hand instead of a Synchronizer.
+    void sender_pushed(Sender &sender) {
+        policy.push(std::move(*sender.msg), msg_queue);
+        sender.accepted = true;
+        drop_expired();
+        if (auto *waiter = waiter_for_head()) {
+            give(*waiter);
+            count_empty.release();
+            hand_off();
+        } else {
+            count_full.release();
+        }
+        check_counts();
+    }
+
+    // Coroutines served under the mutex queue up on a per-thread list, in
+    // order, for the Resumer of the operation that served them.
+    static void resume_later(Suspended &s) {
+        (resume_tail == nullptr ? resume_head : resume_tail->next_ready) = &s;
+        resume_tail = &s;
+    }
+
+    // Declared first in every public operation, so that it runs once the
+    // operation no longer holds the mutex: serves parked senders, then
+    // resumes the coroutines served on this thread.
+    class Resumer {
+    public:
+        explicit Resumer(Queue &queue_)
+            : queue{queue_} {}
+        Resumer(Resumer const &) = delete;
+        Resumer(Resumer &&) = delete;
+        Resumer &operator=(Resumer const &) = delete;
+        Resumer &operator=(Resumer &&) = delete;
+        ~Resumer() {
+            queue.serve_senders();
+            while (auto *s = resume_head) {
+                resume_head = s->next_ready;
+                if (resume_head == nullptr) { resume_tail = nullptr; }
+                s->next_ready = nullptr;
+                s->handle.resume();
+            }
+        }
+
+    private:
+        Queue &queue;  // NOLINT
+    };
+
+    // Called whenever a new head shows up without a slot of count_full in
+    // hand: claims one for every message given to a blocked receiver.
+    void hand_off() {
+        drop_expired();
+        while (auto *waiter = waiter_for_head()) {
+            if (!count_full.try_acquire()) { break; }
+            give(*waiter);
+            count_empty.release();
+            drop_expired();
+        }
+        check_counts();
+    }
+
+    // Mode::DEADLINE only: whether the message served next is past its
+    // deadline.
+    [[nodiscard]] bool head_expired() {
+        return policy.get_mode() == Mode::DEADLINE && !msg_queue.empty()
+               && top_deadline_of(msg_queue) <= std::chrono::steady_clock::now();
+    }
+
+    // Drops expired heads for as long as count_full has a spare slot to pay
+    // for them. A head whose slot is already held by a receiver is left to
+    // that receiver, see skip_expired.
+    void drop_expired() {
+        std::size_t dropped{0};
+        for (; head_expired() && count_full.try_acquire(); ++dropped) { pop(); }
+        if (dropped == 0) { return; }
+        dropped_expired += dropped;
+        count_empty.release(dropped);
+    }
+
+    // Called with a slot of count_full in hand and the mutex held. Drops
+    // expired heads, paying for each with the caller's slot and taking
+    // another one for the next head. Returns false if none was left: the
+    // caller's slot then went with the last message dropped.
+    bool skip_expired() {
+        while (head_expired()) {
+            pop();
+            ++dropped_expired;
+            if (!count_full.try_acquire()) {
+                hand_off();
+                return false;
+            }
+            count_empty.release();
+        }
+        return true;
+    }
+
+    // Moves heads to out for as many slots of count_full as the caller took,
+    // dropping expired ones on the way. Slots left over pay for heads wanted
+    // by blocked receivers first, and only then go back to count_full.
+    template <typename OutputIt>
+    std::size_t take_bulk(OutputIt out,
+                          std::size_t slots,
+                          std::predicate<Mtype const &> auto const &pred) {
+        if (slots == 0) { return 0; }
+        std::size_t taken{0};
+        std::size_t dropped{0};
+        std::size_t handed{0};
+        {
+            std::lock_guard lck{mutex};
+            while (taken + dropped < slots && !msg_queue.empty()) {
+                if (head_expired()) {
+                    pop();
+                    ++dropped;
+                    continue;
+                }
+                if (!std::invoke(pred, policy.peek(msg_queue))) { break; }
+                *out = policy.move(msg_queue);
+                pop();
+                ++taken;
+                ++out;
+            }
+            dropped_expired += dropped;
+            while (taken + dropped + handed < slots) {
+                auto *waiter = waiter_for_head();
+                if (waiter == nullptr) { break; }
+                give(*waiter);
+                ++handed;
+            }
+            hand_off();
+        }
+        count_full.release(slots - taken - dropped - handed);
+        count_empty.release(taken + dropped + handed);
+        return taken;
+    }
+
+    // Called with a slot of count_full in hand and the mutex held.
+    std::optional<Mtype>
+    take_head_if(synch::Synchronizer &s,
+                 std::predicate<Mtype const &> auto const &pred) {
+        if (!skip_expired()) { return {}; }
+        if (!msg_queue.empty() && std::invoke(pred, policy.peek(msg_queue))) {
+            std::optional<Mtype> msg{policy.move(msg_queue)};
+            pop();
+            hand_off();
+            return msg;
+        }
+        rejected(s);
+        return {};
+    }
+
+    // Called with a slot of count_empty in hand and the mutex held.
+    bool push_locked(synch::Synchronizer &s, Mtype &&msg) {
+        if (!push(std::move(msg))) {
+            s.rollback();
+            return false;
+        }
+        pushed(s);
+        return true;
+    }
+
+    template <typename... Args>
+    bool emplace_locked(synch::Synchronizer &s, Args &&...args) {
+        if (full()) {
+            s.rollback();
+            return false;
+        }
+        policy.emplace(msg_queue, std::forward<Args>(args)...);
+        pushed(s);
+        return true;
+    }
+
+    // Wrap the insertion of one message, to be run with the mutex held once
+    // there is room for it.
+    auto pusher(Mtype &msg) {
+        return [this, &msg] { policy.push(std::move(msg), msg_queue); };
+    }
+    template <typename... Args>
+    auto emplacer(Args &&...args) {
+        return [this, &args...] { policy.emplace(msg_queue, std::forward<Args>(args)...); };
+    }
+
+    // Enqueue for every policy but BLOCK. Only a queue that is full with the
+    // mutex held overflows: when count_empty is merely exhausted by a thread
+    // between its slot and the mutex, the producer yields and retries.
+    bool enqueue_lossy(std::invocable auto const &insert) {
+        for (;;) {
+            {
+                synch::Synchronizer s{count_empty, count_full, mutex, std::try_to_lock};
+                if (s.owns_slot()) {
+                    insert();
+                    pushed(s);
+                    return true;
+                }
+            }
+            {
+                std::lock_guard lck{mutex};
+                if (full()) { return overflowed(insert); }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Called with the mutex held and the queue full. Slots are untouched:
+    // DROP_OLDEST swaps one message for another.
+    bool overflowed(std::invocable auto const &insert) {
+        switch (overflow) {
+        case Overflow::REJECT:
+            ++counters.rejected;
+            return false;
+        case Overflow::DROP_NEWEST:
+            ++counters.dropped_newest;
+            return true;
+        case Overflow::DROP_OLDEST:
+            msg_queue.pop_front();
+            insert();
+            ++counters.dropped_oldest;
+            hand_off();
+            return true;
+        case Overflow::BLOCK:
+            break;
+        }
+        return false;
+    }
+
+    // A receiver holding a slot of count_full did not take anything. The
+    // slot pays for the head if a blocked receiver wants it, otherwise it goes
+    // back to count_full: nothing left the queue, so count_empty must not
+    // grow.
+    void rejected(synch::Synchronizer &s) {
+        if (auto *waiter = waiter_for_head()) {
+            give(*waiter);
+            hand_off();
+        } else {
+            s.rollback();
+        }
+        check_counts();
+    }
+
+    // The message just pushed never becomes visible if a blocked receiver
+    // takes the head right away: the producer's slot is handed back.
+    void pushed(synch::Synchronizer &s) {
+        drop_expired();
+        if (auto *waiter = waiter_for_head()) {
+            give(*waiter);
+            s.rollback();
+            hand_off();
+        }
+        check_counts();
+    }
+
+    // Slots are only ever taken before a message is moved and only given
+    // back after, so with the mutex held neither semaphore may promise more
+    // than the container can deliver. Asserted unless NDEBUG is defined.
+    [[nodiscard]] bool counts_hold() const {
+        return count_full.available() <= msg_queue.size()
+               && count_empty.available() <= max_size - msg_queue.size();
+    }
+    void check_counts() const { assert(counts_hold()); }
+
+    [[nodiscard]] bool full() const { return msg_queue.size() == max_size; }
+    [[nodiscard]] bool empty() const { return msg_queue.empty(); }
+    void pop() { policy.pop(msg_queue); }
     [[nodiscard]] std::size_t size() const noexcept { return max_size; }
-    // std::size_t count() const noexcept { return msg_queue->size(); }
+    // std::size_t count() const noexcept { return msg_queue.size(); }
     bool push(Mtype &&msg) {
         if (full()) { return false; }
-        queue_manipulator->push(std::move(msg), *msg_queue);
+        policy.push(std::move(msg), msg_queue);
 #ifdef DEBUG
-        std::cout << "Queue size after push: " << msg_queue->size() << '\n';
+        std::cout << "Queue size after push: " << msg_queue.size() << '\n';
 #endif
         return true;
     }
-    std::unique_ptr<BaseQueueManipulator<Mtype>> queue_manipulator{
-        new QueueManipulatorLIFO<Mtype>{}};
-    std::unique_ptr<BaseQueue<Mtype>> msg_queue;
-    std::mutex mutex{};
+    [[no_unique_address]] Policy policy{};
+    Storage msg_queue;
+    mutable std::mutex mutex{};
     std::size_t max_size;
+    Overflow overflow;
+    OverflowCounters counters{};
+    std::size_t dropped_expired{0};
     sem::Semaphore count_full, count_empty;
+    Waiter *waiters_head{nullptr};
+    Waiter *waiters_tail{nullptr};
+    Sender *senders_head{nullptr};
+    Sender *senders_tail{nullptr};
+    std::atomic<std::size_t> senders_waiting{0};
+    inline static thread_local Suspended *resume_head{nullptr};
+    inline static thread_local Suspended *resume_tail{nullptr};
+    // Last, so that its thread stops before anything it enqueues into goes.
+    std::once_flag delayed_once{};
+    std::unique_ptr<DelayLine<Mtype, Queue>> delayed{};
 };
 
 template <typename Mtype = void, ValidQueue QueueType>
 explicit Queue(QueueType &&, std::size_t)
     -> Queue<typename std::remove_cvref_t<QueueType>::value_type>;
+template <typename Mtype = void, ValidQueue QueueType>
+explicit Queue(QueueType &&, std::size_t, Overflow)
+    -> Queue<typename std::remove_cvref_t<QueueType>::value_type>;
 
+// Selects the lock-free RingBuffer as the storage of a Queue.
 template <std::movable Mtype>
+struct RingStorage {};
+
+// A ring backed queue bypasses the mutex and the semaphores entirely. It is
+// always FIFO.
+template <std::movable Mtype>
+class Queue<Mtype, Fifo, RingBuffer<Mtype>> {
+    inline static constexpr std::size_t s_default_size{1000};
+
+public:
+    using value_type = Mtype;
+
+    explicit Queue(RingStorage<Mtype>,
+                   std::size_t max_size_ = s_default_size,
+                   Overflow overflow_ = Overflow::BLOCK)
+        : ring{max_size_}
+        , overflow{overflow_} {}
+
+    std::optional<Mtype>
+    dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        return ring.pop_if(pred);
+    }
+
+    std::optional<Mtype>
+    try_dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::optional<Mtype> msg{};
+        ring.try_pop_if(pred, msg);
+        return msg;
+    }
+
+    // Waits until the head element satisfies pred, the deadline expires or
+    // a stop is requested on stop. Waiting receivers are woken whenever a
+    // message arrives or the head is taken, and test the head again.
+    std::optional<Mtype>
+    dequeue_wait_if(std::predicate<Mtype const &> auto const &pred,
+                    std::chrono::steady_clock::time_point deadline,
+                    std::stop_token const &stop = {}) {
+        return ring.pop_if_until(pred, deadline, stop);
+    }
+
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t dequeue_bulk_if(OutputIt out,
+                                std::size_t max_n,
+                                std::predicate<Mtype const &> auto const &pred) {
+        if (max_n == 0) { return 0; }
+        auto first = ring.pop_if(pred);
+        if (!first) { return 0; }
+        *out = std::move(*first);
+        return 1 + drain_if(++out, max_n - 1, pred);
+    }
+
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t drain_if(OutputIt out,
+                         std::size_t max_n,
+                         std::predicate<Mtype const &> auto const &pred) {
+        std::size_t taken{0};
+        for (std::optional<Mtype> msg{};
+             taken < max_n
+             && ring.try_pop_if(pred, msg) == RingBuffer<Mtype>::PopResult::TAKEN;
+             ++taken, ++out) {
+            *out = std::move(*msg);
+            msg.reset();
+        }
+        return taken;
+    }
+
+    bool enqueue(Mtype &&msg) {
+        if (overflow != Overflow::BLOCK) { return emplace_lossy(std::move(msg)); }
+        ring.push(std::move(msg));
+        return true;
+    }
+
+    bool try_enqueue(Mtype &&msg) {
+        if (overflow != Overflow::BLOCK) { return emplace_lossy(std::move(msg)); }
+        return ring.try_push(std::move(msg));
+    }
+
+    bool enqueue_until(Mtype &&msg, std::chrono::steady_clock::time_point deadline) {
+        if (overflow != Overflow::BLOCK) { return emplace_lossy(std::move(msg)); }
+        return ring.emplace_until(deadline, std::move(msg));
+    }
+
+    void enqueue_at(Mtype &&msg, std::chrono::steady_clock::time_point due) {
+        std::call_once(delayed_once, [this] {
+            delayed = std::make_unique<DelayLine<Mtype, Queue>>(*this, overflow == Overflow::BLOCK);
+        });
+        delayed->schedule(std::move(msg), due);
+    }
+
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        if (overflow != Overflow::BLOCK) { return emplace_lossy(std::forward<Args>(args)...); }
+        ring.emplace(std::forward<Args>(args)...);
+        return true;
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        if (overflow != Overflow::BLOCK) { return emplace_lossy(std::forward<Args>(args)...); }
+        return ring.try_emplace(std::forward<Args>(args)...);
+    }
+
+    // Waits for room for the first message only. Returns how many messages
+    // were accepted before the ring filled up.
+    template <std::forward_iterator It, std::sentinel_for<It> Sentinel>
+    std::size_t enqueue_bulk(It first, Sentinel last)
+        requires std::constructible_from<Mtype, std::iter_rvalue_reference_t<It>>
+    {
+        if (first == last) { return 0; }
+        std::size_t accepted{0};
+        if (overflow != Overflow::BLOCK) {
+            for (; first != last && emplace_lossy(std::ranges::iter_move(first)); ++first) {
+                ++accepted;
+            }
+            return accepted;
+        }
+        ring.emplace(std::ranges::iter_move(first));
+        for (++accepted, ++first;
+             first != last && ring.try_emplace(std::ranges::iter_move(first));
+             ++first) {
+            ++accepted;
+        }
+        return accepted;
+    }
+
+    [[nodiscard]] static constexpr Mode mode() noexcept { return Mode::FIFO; }
+
+    [[nodiscard]] OverflowCounters overflow_counters() const noexcept {
+        return {dropped_newest.load(std::memory_order_relaxed),
+                dropped_oldest.load(std::memory_order_relaxed),
+                rejected.load(std::memory_order_relaxed)};
+    }
+
+private:
+    // DROP_OLDEST pops the head to make room, as a consumer would, so it
+    // may race with other producers for the freed cell and pop again.
+    template <typename... Args>
+    bool emplace_lossy(Args &&...args) {
+        while (!ring.try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+            switch (overflow) {
+            case Overflow::REJECT:
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            case Overflow::DROP_NEWEST:
+                dropped_newest.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            case Overflow::DROP_OLDEST:
+                if (std::optional<Mtype> oldest{};
+                    ring.try_pop(oldest) == RingBuffer<Mtype>::PopResult::TAKEN) {
+                    dropped_oldest.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            case Overflow::BLOCK:
+                ring.emplace(std::forward<Args>(args)...);  // NOLINT
+                return true;
+            }
+        }
+        return true;
+    }
+
+    RingBuffer<Mtype> ring;
+    Overflow overflow;
+    std::atomic<std::size_t> dropped_newest{0};
+    std::atomic<std::size_t> dropped_oldest{0};
+    std::atomic<std::size_t> rejected{0};
+    std::once_flag delayed_once{};
+    std::unique_ptr<DelayLine<Mtype, Queue>> delayed{};
+};
+
+template <std::movable Mtype>
+explicit Queue(RingStorage<Mtype>, std::size_t)
+    -> Queue<Mtype, Fifo, RingBuffer<Mtype>>;
+template <std::movable Mtype>
+explicit Queue(RingStorage<Mtype>, std::size_t, Overflow)
+    -> Queue<Mtype, Fifo, RingBuffer<Mtype>>;
+
+template <std::movable Mtype, typename QueueType = Queue<Mtype>>
 class Receiver {
+protected:
+    inline static constexpr AcceptAll s_any{};
+
 public:
-    explicit Receiver(Queue<Mtype> &q)
+    explicit Receiver(QueueType &q)
         : queue{q} {}
 
     std::optional<Mtype> dequeue_if(std::predicate<Mtype const &> auto &&pred) {
         return queue.dequeue_if(std::forward<decltype(pred)>(pred));
     }
 
-private:
-    Queue<Mtype> &queue;  // NOLINT
+    // Never blocks: returns nothing if the queue is empty or the head is
+    // rejected by pred. Cheap enough to be polled from an event loop.
+    std::optional<Mtype> try_dequeue_if(std::predicate<Mtype const &> auto &&pred) {
+        return queue.try_dequeue_if(std::forward<decltype(pred)>(pred));
+    }
+
+    std::optional<Mtype>
+    dequeue_first_if(std::predicate<Mtype const &> auto &&pred,
+                     std::size_t max_scan = std::numeric_limits<std::size_t>::max()) {
+        return queue.dequeue_first_if(std::forward<decltype(pred)>(pred), max_scan);
+    }
+
+    // Waits for at least one message, then writes up to max_n of them to out
+    // in one go, stopping at the first one rejected by pred.
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t dequeue_bulk(OutputIt out,
+                             std::size_t max_n,
+                             std::predicate<Mtype const &> auto const &pred) {
+        return queue.dequeue_bulk_if(std::move(out), max_n, pred);
+    }
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t dequeue_bulk(OutputIt out, std::size_t max_n) {
+        return dequeue_bulk(std::move(out), max_n, s_any);
+    }
+
+    // Appends every message available right now to container, without
+    // waiting, stopping at the first one rejected by pred.
+    template <typename Container>
+    std::size_t drain_into(Container &container,
+                           std::predicate<Mtype const &> auto const &pred) {
+        return queue.drain_if(std::back_inserter(container),
+                              std::numeric_limits<std::size_t>::max(),
+                              pred);
+    }
+    template <typename Container>
+    std::size_t drain_into(Container &container) {
+        return drain_into(container, s_any);
+    }
+
+    // For coroutines: co_await receiver.async_dequeue() suspends until a
+    // matching message arrives, without blocking the thread, and yields it.
+    auto async_dequeue(std::predicate<Mtype const &> auto pred) {
+        return queue.async_dequeue_if(std::move(pred));
+    }
+    auto async_dequeue() { return async_dequeue(s_any); }
+
+protected:
+    QueueType &queue;  // NOLINT
 };
-template <std::movable Mtype>
-Receiver(Queue<Mtype> &) -> Receiver<Mtype>;
+template <typename QueueType>
+Receiver(QueueType &) -> Receiver<typename QueueType::value_type, QueueType>;
 
-template <std::movable Mtype>
-class BlockingReceiver : public Receiver<Mtype> {};
+// A Receiver that can also sleep until a matching message arrives, instead of
+// polling dequeue_if.
+template <std::movable Mtype, typename QueueType = Queue<Mtype>>
+class BlockingReceiver : public Receiver<Mtype, QueueType> {
+    using Receiver<Mtype, QueueType>::s_any;
 
-template <std::movable Mtype>
+public:
+    using Receiver<Mtype, QueueType>::Receiver;
+
+    Mtype dequeue(std::predicate<Mtype const &> auto const &pred) {
+        return *this->queue.dequeue_wait_if(
+            pred, std::chrono::steady_clock::time_point::max());
+    }
+    Mtype dequeue() { return dequeue(s_any); }
+
+    // Waits until a matching message arrives or a stop is requested on
+    // stop, e.g. by the std::jthread running the receiver.
+    std::optional<Mtype> dequeue(std::stop_token stop,
+                                 std::predicate<Mtype const &> auto const &pred) {
+        return this->queue.dequeue_wait_if(
+            pred, std::chrono::steady_clock::time_point::max(), std::move(stop));
+    }
+    std::optional<Mtype> dequeue(std::stop_token stop) { return dequeue(std::move(stop), s_any); }
+
+    template <typename Rep, typename Period>
+    std::optional<Mtype>
+    dequeue_for(std::chrono::duration<Rep, Period> const &timeout,
+                std::predicate<Mtype const &> auto const &pred) {
+        return this->queue.dequeue_wait_if(
+            pred,
+            std::chrono::steady_clock::now()
+                + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout));
+    }
+    template <typename Rep, typename Period>
+    std::optional<Mtype>
+    dequeue_for(std::chrono::duration<Rep, Period> const &timeout) {
+        return dequeue_for(timeout, s_any);
+    }
+
+    template <typename Clock, typename Duration>
+    std::optional<Mtype>
+    dequeue_until(std::chrono::time_point<Clock, Duration> const &deadline,
+                  std::predicate<Mtype const &> auto const &pred) {
+        return dequeue_for(deadline - Clock::now(), pred);
+    }
+    template <typename Clock, typename Duration>
+    std::optional<Mtype>
+    dequeue_until(std::chrono::time_point<Clock, Duration> const &deadline) {
+        return dequeue_until(deadline, s_any);
+    }
+};
+template <typename QueueType>
+BlockingReceiver(QueueType &)
+    -> BlockingReceiver<typename QueueType::value_type, QueueType>;
+
+template <std::movable Mtype, typename QueueType = Queue<Mtype>>
 class Producer {
 public:
-    explicit Producer(Queue<Mtype> &q)
+    explicit Producer(QueueType &q)
         : queue{q} {}
     bool enqueue(Mtype &&msg) { return queue.enqueue(std::move(msg)); }
+    // Never blocks: returns false if the queue is full, and msg is left
+    // untouched.
+    bool try_enqueue(Mtype &&msg) { return queue.try_enqueue(std::move(msg)); }
+    // Waits for room no longer than timeout. On timeout returns false and msg
+    // is left untouched, so the caller can shed or reroute it.
+    template <typename Rep, typename Period>
+    bool enqueue_for(Mtype &&msg, std::chrono::duration<Rep, Period> const &timeout) {
+        return queue.enqueue_until(
+            std::move(msg),
+            std::chrono::steady_clock::now()
+                + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout));
+    }
+    template <typename Clock, typename Duration>
+    bool enqueue_until(Mtype &&msg,
+                       std::chrono::time_point<Clock, Duration> const &deadline) {
+        return enqueue_for(std::move(msg), deadline - Clock::now());
+    }
+    // Delayed delivery: receivers only see msg once it is due.
+    template <typename Rep, typename Period>
+    void enqueue_after(Mtype &&msg, std::chrono::duration<Rep, Period> const &delay) {
+        queue.enqueue_at(
+            std::move(msg),
+            std::chrono::steady_clock::now()
+                + std::chrono::ceil<std::chrono::steady_clock::duration>(delay));
+    }
+    template <typename Clock, typename Duration>
+    void enqueue_at(Mtype &&msg, std::chrono::time_point<Clock, Duration> const &due) {
+        enqueue_after(std::move(msg), due - Clock::now());
+    }
+    // For coroutines: co_await producer.async_enqueue(msg) suspends while the
+    // queue is full, without blocking the thread.
+    auto async_enqueue(Mtype &&msg) { return queue.async_enqueue(std::move(msg)); }
+    // Builds the message directly inside the queue storage.
+    template <typename... Args>
+    bool emplace(Args &&...args) {
+        return queue.emplace(std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    bool try_emplace(Args &&...args) {
+        return queue.try_emplace(std::forward<Args>(args)...);
+    }
+    // Moves a burst of messages in at once. Returns how many were accepted,
+    // which is less than requested if the queue filled up.
+    template <std::forward_iterator It, std::sentinel_for<It> Sentinel>
+    std::size_t enqueue_bulk(It first, Sentinel last) {
+        return queue.enqueue_bulk(std::move(first), std::move(last));
+    }
+    template <std::ranges::forward_range Range>
+    std::size_t enqueue_bulk(Range &&msgs) {
+        return enqueue_bulk(std::ranges::begin(msgs), std::ranges::end(msgs));
+    }
 
 private:
-    Queue<Mtype> &queue;  // NOLINT
+    QueueType &queue;  // NOLINT
 };
-template <std::movable Mtype>
-Producer(Queue<Mtype> &) -> Producer<Mtype>;
+template <typename QueueType>
+Producer(QueueType &) -> Producer<typename QueueType::value_type, QueueType>;
 }  // namespace mq
 
 #endif
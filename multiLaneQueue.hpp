@@ -0,0 +1,297 @@
+#ifndef MULTI_LANE_QUEUE
+#define MULTI_LANE_QUEUE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "messageQueue.hpp"
+#include "ringBuffer.hpp"
+#include "semaphore.hpp"
+
+namespace mq {
+
+// Lanes bounded lock-free rings, one per priority level, drained by weight so
+// that a burst on a high lane cannot starve the low ones: while every lane is
+// backlogged, lane i gets weights[i] out of every sum(weights) dequeues.
+// A lane with nothing to give hands its turn to the highest non-empty lane.
+// LaneFn projects a message to its lane; lanes past Lanes - 1 count as
+// Lanes - 1, negative ones as 0. Each lane sits on its own cache lines, so
+// producers on different lanes never touch the same memory.
+// Messages cost one unit each, which makes deficit round robin a fixed
+// schedule: it is computed once, interleaved, and receivers share it through
+// a single ticket counter.
+template <std::movable Mtype, typename LaneFn, std::size_t Lanes>
+    requires std::regular_invocable<LaneFn const &, Mtype const &> && (Lanes >= 1)
+class MultiLaneQueue {
+    using Clock = std::chrono::steady_clock;
+    using PopResult = typename RingBuffer<Mtype>::PopResult;
+
+    inline static constexpr std::size_t s_default_size{1000};
+
+    struct alignas(cache_line_size) Lane {
+        explicit Lane(std::size_t capacity_)
+            : ring{capacity_} {}
+
+        RingBuffer<Mtype> ring;
+    };
+
+public:
+    using value_type = Mtype;
+
+    // Every lane holds up to lane_size messages (rounded up to a power of
+    // two).
+    MultiLaneQueue(LaneFn lane_of_,
+                   std::array<std::size_t, Lanes> const &weights,
+                   std::size_t lane_size = s_default_size)
+        : lane_of{std::move(lane_of_)}
+        , lanes{make_lanes(lane_size, std::make_index_sequence<Lanes>{})}
+        , schedule{make_schedule(weights)} {}
+
+    bool enqueue(Mtype &&msg) {
+        lane_for(msg).push(std::move(msg));
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool try_enqueue(Mtype &&msg) {
+        if (!lane_for(msg).try_push(std::move(msg))) { return false; }
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool enqueue_until(Mtype &&msg, Clock::time_point deadline) {
+        if (!lane_for(msg).emplace_until(deadline, std::move(msg))) { return false; }
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Keeps msg out of the queue until due, then enqueues it from a timer
+    // thread started on first use.
+    void enqueue_at(Mtype &&msg, Clock::time_point due) {
+        std::call_once(delayed_once, [this] {
+            delayed = std::make_unique<DelayLine<Mtype, MultiLaneQueue>>(*this, true);
+        });
+        delayed->schedule(std::move(msg), due);
+    }
+
+    // The lane is only known once the message exists, so it is built first
+    // and then moved in.
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return try_enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    // Waits for room for the first message only, and wakes receivers once:
+    // one receiver for one message, all of them for more.
+    // Each message is only moved once its lane accepts it: the rest are left
+    // untouched.
+    template <std::forward_iterator It, std::sentinel_for<It> Sentinel>
+    std::size_t enqueue_bulk(It first, Sentinel last)
+        requires std::constructible_from<Mtype, std::iter_rvalue_reference_t<It>>
+    {
+        if (first == last) { return 0; }
+        lane_for(*first).emplace(std::ranges::iter_move(first));
+        std::size_t accepted{1};
+        for (++first; first != last; ++first, ++accepted) {
+            if (!lane_for(*first).try_emplace(std::ranges::iter_move(first))) { break; }
+        }
+        if (accepted == 1) {
+            not_empty.notify_one();
+        } else {
+            not_empty.notify_all();
+        }
+        return accepted;
+    }
+
+    // Returns nothing if every lane is empty, or if the head of the lane
+    // whose turn it is gets rejected by pred.
+    std::optional<Mtype>
+    try_dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::optional<Mtype> msg{};
+        take_next_if(pred, msg);
+        return msg;
+    }
+
+    // Blocks while every lane is empty.
+    std::optional<Mtype>
+    dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::optional<Mtype> msg{};
+        while (take_next_if(pred, msg) == PopResult::EMPTY) {
+            auto const key = not_empty.prepare_wait();
+            if (take_next_if(pred, msg) != PopResult::EMPTY) {
+                not_empty.cancel_wait();
+                break;
+            }
+            not_empty.wait(key);
+        }
+        return msg;
+    }
+
+    // Waits for a message accepted by pred at the head of any lane. Heads are
+    // re-checked whenever a message arrives or a head is taken. A stop
+    // request on stop gives up waiting too.
+    // Other receivers are woken one per message while no such waiter is
+    // parked.
+    std::optional<Mtype>
+    dequeue_wait_if(std::predicate<Mtype const &> auto const &pred,
+                    Clock::time_point deadline,
+                    std::stop_token const &stop = {}) {
+        std::optional<Mtype> msg{};
+        if (take_any_if(pred, msg)) { return msg; }
+        std::stop_callback const on_stop{stop, [this] { not_empty.notify_all(); }};
+        not_empty.add_filtered();
+        for (;;) {
+            auto const key = not_empty.prepare_wait();
+            if (take_any_if(pred, msg) || stop.stop_requested() || Clock::now() >= deadline) {
+                not_empty.cancel_wait();
+                break;
+            }
+            if (deadline == Clock::time_point::max()) {
+                not_empty.wait(key);
+            } else {
+                not_empty.wait_until(key, deadline);
+            }
+        }
+        not_empty.remove_filtered();
+        return msg;
+    }
+
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t dequeue_bulk_if(OutputIt out,
+                                std::size_t max_n,
+                                std::predicate<Mtype const &> auto const &pred) {
+        if (max_n == 0) { return 0; }
+        auto first = dequeue_if(pred);
+        if (!first) { return 0; }
+        *out = std::move(*first);
+        return 1 + drain_if(++out, max_n - 1, pred);
+    }
+
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t drain_if(OutputIt out,
+                         std::size_t max_n,
+                         std::predicate<Mtype const &> auto const &pred) {
+        std::size_t taken{0};
+        for (std::optional<Mtype> msg{};
+             taken < max_n && take_next_if(pred, msg) == PopResult::TAKEN;
+             ++taken, ++out) {
+            *out = std::move(*msg);
+            msg.reset();
+        }
+        return taken;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        std::size_t total{0};
+        for (auto const &lane : lanes) { total += lane.ring.size(); }
+        return total;
+    }
+    [[nodiscard]] static constexpr std::size_t lane_count() noexcept { return Lanes; }
+    [[nodiscard]] std::size_t lane_size(std::size_t lane) const noexcept {
+        return lanes[lane].ring.size();
+    }
+
+private:
+    template <std::size_t... Is>
+    static std::array<Lane, Lanes> make_lanes(std::size_t lane_size,
+                                              std::index_sequence<Is...>) {
+        return {Lane{(static_cast<void>(Is), lane_size)}...};
+    }
+
+    // Smooth weighted round robin: spreads each lane's turns over the round
+    // instead of serving them back to back. Ties go to the higher lane.
+    static std::vector<std::uint8_t>
+    make_schedule(std::array<std::size_t, Lanes> weights) {
+        static_assert(Lanes <= 256);
+        auto total = std::accumulate(weights.begin(), weights.end(), std::size_t{0});
+        if (total == 0) {
+            weights.fill(1);
+            total = Lanes;
+        }
+        std::vector<std::uint8_t> turns(total);
+        std::array<std::ptrdiff_t, Lanes> credit{};
+        for (auto &turn : turns) {
+            std::size_t best{Lanes - 1};
+            for (std::size_t i = Lanes; i-- > 0;) {
+                credit[i] += static_cast<std::ptrdiff_t>(weights[i]);
+                if (credit[i] > credit[best]) { best = i; }
+            }
+            credit[best] -= static_cast<std::ptrdiff_t>(total);
+            turn = static_cast<std::uint8_t>(best);
+        }
+        return turns;
+    }
+
+    RingBuffer<Mtype> &lane_for(Mtype const &msg) {
+        auto const lane = std::invoke(lane_of, msg);
+        if constexpr (std::is_signed_v<decltype(lane)>) {
+            if (lane < 0) { return lanes[0].ring; }
+        }
+        return lanes[std::min(static_cast<std::size_t>(lane), Lanes - 1)].ring;
+    }
+
+    // Tries the lane whose turn it is, then the others from the highest down.
+    // Only the head of the first non-empty lane is tested.
+    PopResult take_next_if(std::predicate<Mtype const &> auto const &pred,
+                           std::optional<Mtype> &out) {
+        auto const turn = schedule[ticket.fetch_add(1, std::memory_order_relaxed) % schedule.size()];
+        auto result = lanes[turn].ring.try_pop_if(pred, out);
+        for (std::size_t i = Lanes; result == PopResult::EMPTY && i-- > 0;) {
+            if (i != turn) { result = lanes[i].ring.try_pop_if(pred, out); }
+        }
+        if (result == PopResult::TAKEN) { head_taken(); }
+        return result;
+    }
+
+    // Highest lane first, skipping heads rejected by pred.
+    bool take_any_if(std::predicate<Mtype const &> auto const &pred,
+                     std::optional<Mtype> &out) {
+        for (std::size_t i = Lanes; i-- > 0;) {
+            if (lanes[i].ring.try_pop_if(pred, out) == PopResult::TAKEN) {
+                head_taken();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The lane pops moved their dequeue index with a seq_cst CAS, which is
+    // what dequeue_wait_if re-checks.
+    void head_taken() { not_empty.notify_filtered(); }
+
+    [[no_unique_address]] LaneFn lane_of;
+    std::array<Lane, Lanes> lanes;
+    std::vector<std::uint8_t> schedule;
+    alignas(cache_line_size) std::atomic<std::size_t> ticket{0};
+    alignas(cache_line_size) sem::EventCount not_empty{};
+    // Last, so that its thread stops before anything it enqueues into goes.
+    std::once_flag delayed_once{};
+    std::unique_ptr<DelayLine<Mtype, MultiLaneQueue>> delayed{};
+};
+}  // namespace mq
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef PARTITIONED_QUEUE
+#define PARTITIONED_QUEUE
+
+#include <cassert>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace mq {
+
+// Queue split into FIFO partitions, one per key as projected by KeyFn, each
+// consumed by at most one receiver at a time. A receiver leases a partition
+// that has messages and nobody else working on it, takes messages from it
+// with Lease::next() and gives it back when the lease goes away; the
+// partition then becomes ready again for any receiver if more messages came
+// in. Messages with equal keys are therefore handled one after the other, in
+// order, while different keys run in parallel.
+// Ready partitions are leased in the order they became ready. A partition
+// with nothing queued and no lease costs nothing: it is forgotten.
+template <std::movable Mtype, typename KeyFn>
+    requires std::regular_invocable<KeyFn const &, Mtype const &>
+class PartitionedQueue {
+    using Clock = std::chrono::steady_clock;
+
+    inline static constexpr std::size_t s_default_size{1000};
+    inline static constexpr Clock::time_point s_no_wait{Clock::time_point::min()};
+    inline static constexpr Clock::time_point s_forever{Clock::time_point::max()};
+
+public:
+    using value_type = Mtype;
+    using key_type = std::remove_cvref_t<std::invoke_result_t<KeyFn const &, Mtype const &>>;
+
+private:
+    struct Partition {
+        std::deque<Mtype> messages{};
+        bool leased{false};
+    };
+    using Partitions = std::unordered_map<key_type, Partition>;
+    // Elements of an unordered_map keep their address until erased.
+    using Entry = typename Partitions::value_type;
+
+public:
+    // Exclusive right to consume one partition. Move-only; the partition is
+    // given back on destruction.
+    class Lease {
+    public:
+        Lease(Lease const &) = delete;
+        Lease &operator=(Lease const &) = delete;
+        Lease(Lease &&other) noexcept
+            : queue{std::exchange(other.queue, nullptr)}
+            , entry{std::exchange(other.entry, nullptr)} {}
+        Lease &operator=(Lease &&other) noexcept {
+            if (this != &other) {
+                release();
+                queue = std::exchange(other.queue, nullptr);
+                entry = std::exchange(other.entry, nullptr);
+            }
+            return *this;
+        }
+        ~Lease() { release(); }
+
+        // key() and next() must not be called once the lease was released or
+        // moved from: a drained partition is forgotten when given back.
+        [[nodiscard]] key_type const &key() const noexcept {
+            assert(entry != nullptr);
+            return entry->first;
+        }
+
+        // Next message of the partition, nothing once it is drained. Never
+        // waits.
+        std::optional<Mtype> next() {
+            assert(queue != nullptr);
+            return queue->take(*entry);
+        }
+
+        // Gives the partition back before destruction.
+        void release() {
+            if (queue != nullptr) {
+                std::exchange(queue, nullptr)->give_back(*std::exchange(entry, nullptr));
+            }
+        }
+
+    private:
+        friend class PartitionedQueue;
+        Lease(PartitionedQueue &queue_, Entry &entry_)
+            : queue{&queue_}
+            , entry{&entry_} {}
+
+        PartitionedQueue *queue;
+        Entry *entry;
+    };
+
+    explicit PartitionedQueue(KeyFn key_of_ = {}, std::size_t max_size_ = s_default_size)
+        : key_of{std::move(key_of_)}
+        , capacity{max_size_} {}
+
+    // Producer side. The queue holds up to max_size messages over all
+    // partitions; a message that was not accepted is left untouched.
+    bool enqueue(Mtype &&msg) { return enqueue_until(std::move(msg), s_forever); }
+
+    bool try_enqueue(Mtype &&msg) { return enqueue_until(std::move(msg), s_no_wait); }
+
+    bool enqueue_until(Mtype &&msg, Clock::time_point deadline) {
+        std::unique_lock lck{mutex};
+        if (!wait(lck, not_full, [this] { return count < capacity; }, deadline)) { return false; }
+        put(std::move(msg));
+        return true;
+    }
+
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return try_enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    // Waits for room for the first message only, then accepts messages
+    // until the queue is full.
+    template <std::forward_iterator It, std::sentinel_for<It> Sentinel>
+    std::size_t enqueue_bulk(It first, Sentinel last)
+        requires std::constructible_from<Mtype, std::iter_rvalue_reference_t<It>>
+    {
+        std::size_t accepted{0};
+        std::unique_lock lck{mutex};
+        for (; first != last; ++first, ++accepted) {
+            auto const deadline = accepted == 0 ? s_forever : s_no_wait;
+            if (!wait(lck, not_full, [this] { return count < capacity; }, deadline)) { break; }
+            put(Mtype(std::ranges::iter_move(first)));
+        }
+        return accepted;
+    }
+
+    // Consumer side: blocks until some partition is ready.
+    Lease acquire() { return *acquire_until(s_forever); }
+
+    std::optional<Lease> try_acquire() { return acquire_until(s_no_wait); }
+
+    std::optional<Lease> acquire_until(Clock::time_point deadline) {
+        std::unique_lock lck{mutex};
+        if (!wait(lck, partition_ready, [this] { return !ready.empty(); }, deadline)) { return {}; }
+        auto *entry = ready.front();
+        ready.pop_front();
+        entry->second.leased = true;
+        return Lease{*this, *entry};
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        std::lock_guard lck{mutex};
+        return count;
+    }
+    [[nodiscard]] std::size_t max_size() const noexcept { return capacity; }
+    // Partitions with messages queued or a lease on them.
+    [[nodiscard]] std::size_t partition_count() const {
+        std::lock_guard lck{mutex};
+        return partitions.size();
+    }
+
+private:
+    bool wait(std::unique_lock<std::mutex> &lck,
+              std::condition_variable &cv,
+              std::predicate auto const &done,
+              Clock::time_point deadline) {
+        if (done()) { return true; }
+        if (deadline == s_no_wait) { return false; }
+        if (deadline == s_forever) {
+            cv.wait(lck, done);
+            return true;
+        }
+        return cv.wait_until(lck, deadline, done);
+    }
+
+    void put(Mtype &&msg) {
+        auto const it = partitions.try_emplace(std::invoke(key_of, std::as_const(msg))).first;
+        auto &partition = it->second;
+        partition.messages.push_back(std::move(msg));
+        ++count;
+        if (!partition.leased && partition.messages.size() == 1) { make_ready(*it); }
+    }
+
+    std::optional<Mtype> take(Entry &entry) {
+        std::lock_guard lck{mutex};
+        auto &messages = entry.second.messages;
+        if (messages.empty()) { return {}; }
+        std::optional<Mtype> msg{std::move(messages.front())};
+        messages.pop_front();
+        --count;
+        not_full.notify_one();
+        return msg;
+    }
+
+    void give_back(Entry &entry) {
+        std::lock_guard lck{mutex};
+        entry.second.leased = false;
+        if (entry.second.messages.empty()) {
+            partitions.erase(partitions.find(entry.first));
+        } else {
+            make_ready(entry);
+        }
+    }
+
+    void make_ready(Entry &entry) {
+        ready.push_back(&entry);
+        partition_ready.notify_one();
+    }
+
+    [[no_unique_address]] KeyFn key_of;
+    std::size_t capacity;
+    mutable std::mutex mutex{};
+    Partitions partitions{};
+    // Partitions with messages and no lease, in the order they became so.
+    std::deque<Entry *> ready{};
+    std::size_t count{0};
+    std::condition_variable not_full{};
+    std::condition_variable partition_ready{};
+};
+}  // namespace mq
+
+#endif
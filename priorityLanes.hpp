@@ -0,0 +1,139 @@
+#ifndef PRIORITY_LANES
+#define PRIORITY_LANES
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace mq {
+
+// Message container for Mode::PRIORITY, with one FIFO lane per priority level.
+// PriorityFn projects a message to its level; higher levels are served first
+// and levels past Levels - 1 count as Levels - 1, negative ones as 0.
+// Every message is stamped with its arrival number, so front()/back() still
+// answer in arrival order and a queue can switch between FIFO, LIFO and
+// PRIORITY at any time without reordering anything. A bit per lane tracks the
+// non-empty ones: top() is O(1), front() and back() compare the ends of the
+// non-empty lanes only.
+template <std::movable Mtype, typename PriorityFn, std::size_t Levels = 8>
+    requires std::regular_invocable<PriorityFn const &, Mtype const &>
+             && (Levels >= 1 && Levels <= 64)
+class PriorityLanes {
+    struct Entry {
+        std::uint64_t seq;
+        Mtype msg;
+    };
+    using Lane = std::deque<Entry>;
+
+public:
+    using value_type = Mtype;
+
+    explicit PriorityLanes(PriorityFn priority_of_ = {})
+        : priority_of{std::move(priority_of_)} {}
+
+    void push_back(Mtype &&msg) {
+        auto const level = lane_of(msg);
+        lanes[level].push_back(Entry{next_seq++, std::move(msg)});
+        non_empty |= bit(level);
+        ++count;
+    }
+
+    // Highest priority message, the oldest among equals.
+    Mtype &top() { return lanes[top_lane()].front().msg; }
+    void pop_top() { pop_front_of(top_lane()); }
+
+    Mtype &front() { return lanes[oldest_lane()].front().msg; }
+    void pop_front() { pop_front_of(oldest_lane()); }
+
+    Mtype &back() { return lanes[newest_lane()].back().msg; }
+    void pop_back() {
+        auto const level = newest_lane();
+        lanes[level].pop_back();
+        popped(level);
+    }
+
+    // Selective receive in priority order.
+    template <typename Pred>
+    std::optional<Mtype> extract_top_if(Pred const &pred, std::size_t max_scan) {
+        for (auto mask = non_empty; mask != 0 && max_scan > 0;) {
+            auto const level = highest(mask);
+            mask &= ~bit(level);
+            auto &lane = lanes[level];
+            for (auto it = lane.begin(); it != lane.end() && max_scan > 0; ++it, --max_scan) {
+                if (std::invoke(pred, std::as_const(it->msg))) {
+                    std::optional<Mtype> msg{std::move(it->msg)};
+                    lane.erase(it);
+                    popped(level);
+                    return msg;
+                }
+            }
+        }
+        return {};
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return count; }
+    [[nodiscard]] bool empty() const noexcept { return count == 0; }
+
+private:
+    [[nodiscard]] static constexpr std::uint64_t bit(std::size_t level) noexcept {
+        return std::uint64_t{1} << level;
+    }
+    [[nodiscard]] static constexpr std::size_t highest(std::uint64_t mask) noexcept {
+        return static_cast<std::size_t>(std::bit_width(mask)) - 1;
+    }
+
+    [[nodiscard]] std::size_t lane_of(Mtype const &msg) const {
+        auto const level = std::invoke(priority_of, msg);
+        if constexpr (std::is_signed_v<decltype(level)>) {
+            if (level < 0) { return 0; }
+        }
+        return std::min(static_cast<std::size_t>(level), Levels - 1);
+    }
+
+    [[nodiscard]] std::size_t top_lane() const noexcept { return highest(non_empty); }
+
+    // The lane whose first or last message arrived earliest or latest.
+    template <typename Seq, typename Better>
+    [[nodiscard]] std::size_t find_lane(Seq const &seq_of, Better const &better) const {
+        auto mask = non_empty;
+        auto best = highest(mask);
+        for (mask &= ~bit(best); mask != 0;) {
+            auto const level = highest(mask);
+            mask &= ~bit(level);
+            if (better(seq_of(lanes[level]), seq_of(lanes[best]))) { best = level; }
+        }
+        return best;
+    }
+    [[nodiscard]] std::size_t oldest_lane() const {
+        return find_lane([](Lane const &lane) { return lane.front().seq; }, std::less<>{});
+    }
+    [[nodiscard]] std::size_t newest_lane() const {
+        return find_lane([](Lane const &lane) { return lane.back().seq; }, std::greater<>{});
+    }
+
+    void pop_front_of(std::size_t level) {
+        lanes[level].pop_front();
+        popped(level);
+    }
+    void popped(std::size_t level) {
+        if (lanes[level].empty()) { non_empty &= ~bit(level); }
+        --count;
+    }
+
+    [[no_unique_address]] PriorityFn priority_of;
+    std::array<Lane, Levels> lanes{};
+    std::uint64_t non_empty{0};
+    std::uint64_t next_seq{0};
+    std::size_t count{0};
+};
+}  // namespace mq
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef RING_BUFFER
+#define RING_BUFFER
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "semaphore.hpp"
+
+namespace mq {
+
+inline constexpr std::size_t cache_line_size{64};
+
+// Predicate accepting every message. Pops given it never look at the head
+// before taking it, so a RingBuffer claims the head the lock-free way.
+struct AcceptAll {
+    constexpr bool operator()(auto const &) const noexcept { return true; }
+};
+
+// Bounded multi-producer/multi-consumer ring buffer. Every cell carries a
+// sequence number telling which lap of the ring it belongs to and whether it
+// is empty or full, so producers and consumers only contend on their own
+// index. A consumer taking the head whatever it is claims it by moving the
+// dequeue index past it, as in Vyukov's queue. A conditional pop marks the
+// head cell busy while the predicate inspects it, and only claims it once
+// the predicate accepted; consumers meeting a busy head yield until it is
+// released.
+// The capacity is rounded up to a power of two, and is at least two: with a
+// single cell, a full cell could not be told from an empty one of the next
+// lap.
+template <std::movable Mtype>
+class RingBuffer {
+    struct alignas(cache_line_size) Cell {
+        Cell() {}  // NOLINT
+        Cell(Cell const &) = delete;
+        Cell(Cell &&) = delete;
+        Cell &operator=(Cell const &) = delete;
+        Cell &operator=(Cell &&) = delete;
+        ~Cell() {}  // NOLINT
+
+        std::atomic<std::size_t> seq{};
+        union {
+            Mtype value;
+        };
+    };
+
+    inline static constexpr std::size_t s_busy{~std::size_t{0}};
+
+public:
+    enum class PopResult {
+        TAKEN,
+        REJECTED,
+        EMPTY,
+    };
+
+    explicit RingBuffer(std::size_t capacity_)
+        : capacity{std::bit_ceil(capacity_ < 2 ? std::size_t{2} : capacity_)}
+        , mask{capacity - 1}
+        , cells{std::make_unique<Cell[]>(capacity)} {  // NOLINT
+        for (std::size_t i = 0; i < capacity; ++i) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    RingBuffer(RingBuffer const &) = delete;
+    RingBuffer(RingBuffer &&) = delete;
+    RingBuffer &operator=(RingBuffer const &) = delete;
+    RingBuffer &operator=(RingBuffer &&) = delete;
+    ~RingBuffer() {
+        auto pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;; ++pos) {
+            auto &cell = cells[pos & mask];
+            if (cell.seq.load(std::memory_order_relaxed) != pos + 1) { break; }
+            std::destroy_at(&cell.value);
+        }
+    }
+
+    bool try_push(Mtype &&msg) { return try_emplace(std::move(msg)); }
+
+    void push(Mtype &&msg) { emplace(std::move(msg)); }
+
+    // The message is constructed straight into the claimed cell, so args are
+    // left untouched when the ring is full.
+    template <typename... Args>
+    bool try_emplace(Args &&...args) {
+        auto pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            auto &cell = cells[pos & mask];
+            auto const seq = cell.seq.load(std::memory_order_acquire);
+            if (seq == s_busy) {
+                // A conditional pop is inspecting the cell, full from the
+                // previous lap: the ring is full only if pos is still the
+                // tail.
+                auto const tail = enqueue_pos.load(std::memory_order_relaxed);
+                if (tail == pos) { return false; }
+                pos = tail;
+                continue;
+            }
+            auto const diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    std::construct_at(&cell.value, std::forward<Args>(args)...);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    not_empty.notify_one();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template <typename... Args>
+    void emplace(Args &&...args) {
+        while (!try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+            auto const key = not_full.prepare_wait();
+            if (try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+                not_full.cancel_wait();
+                return;
+            }
+            not_full.wait(key);
+        }
+    }
+
+    // Gives up at deadline, leaving args untouched.
+    template <typename... Args>
+    bool emplace_until(std::chrono::steady_clock::time_point deadline, Args &&...args) {
+        while (!try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+            if (std::chrono::steady_clock::now() >= deadline) { return false; }
+            auto const key = not_full.prepare_wait();
+            if (try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+                not_full.cancel_wait();
+                return true;
+            }
+            not_full.wait_until(key, deadline);
+        }
+        return true;
+    }
+
+    // Takes the head, whatever it is.
+    PopResult try_pop(std::optional<Mtype> &out) {
+        auto pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            auto &cell = cells[pos & mask];
+            auto const seq = cell.seq.load(std::memory_order_acquire);
+            if (seq == s_busy) {
+                std::this_thread::yield();
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+                continue;
+            }
+            auto const diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1)) {
+                    take(cell, pos, out);
+                    return PopResult::TAKEN;
+                }
+            } else if (diff < 0) {
+                return PopResult::EMPTY;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Tests the head element only.
+    PopResult try_pop_if(std::predicate<Mtype const &> auto const &pred,
+                         std::optional<Mtype> &out) {
+        if constexpr (std::is_same_v<std::remove_cvref_t<decltype(pred)>, AcceptAll>) {
+            return try_pop(out);
+        } else {
+            auto pos = dequeue_pos.load(std::memory_order_acquire);
+            for (;;) {
+                auto &cell = cells[pos & mask];
+                auto seq = pos + 1;
+                if (cell.seq.compare_exchange_weak(seq, s_busy, std::memory_order_acquire)) {
+                    if (!std::invoke(pred, std::as_const(cell.value))) {
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return PopResult::REJECTED;
+                    }
+                    // Fails if an unconditional pop claimed the head meanwhile;
+                    // it waits for the cell to be released.
+                    auto expected = pos;
+                    if (dequeue_pos.compare_exchange_strong(expected, pos + 1)) {
+                        move_out(cell, pos, out);
+                        return PopResult::TAKEN;
+                    }
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                } else if (seq == s_busy) {
+                    std::this_thread::yield();
+                } else if (static_cast<std::ptrdiff_t>(seq - (pos + 1)) < 0) {
+                    return PopResult::EMPTY;
+                }
+                pos = dequeue_pos.load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    // Blocks while the ring is empty, then tests the head element only.
+    std::optional<Mtype> pop_if(std::predicate<Mtype const &> auto const &pred) {
+        std::optional<Mtype> out{};
+        while (try_pop_if(pred, out) == PopResult::EMPTY) {
+            auto const key = not_empty.prepare_wait();
+            if (try_pop_if(pred, out) != PopResult::EMPTY) {
+                not_empty.cancel_wait();
+                break;
+            }
+            not_empty.wait(key);
+        }
+        return out;
+    }
+
+    // Waits for a head pred accepts, testing again whenever a message
+    // arrives or the head is taken, until deadline or a stop request on stop.
+    std::optional<Mtype> pop_if_until(std::predicate<Mtype const &> auto const &pred,
+                                      std::chrono::steady_clock::time_point deadline,
+                                      std::stop_token const &stop = {}) {
+        constexpr bool filtered{!std::is_same_v<std::remove_cvref_t<decltype(pred)>, AcceptAll>};
+        std::optional<Mtype> out{};
+        if (try_pop_if(pred, out) == PopResult::TAKEN) { return out; }
+        std::stop_callback const on_stop{stop, [this] { not_empty.notify_all(); }};
+        if constexpr (filtered) { not_empty.add_filtered(); }
+        for (;;) {
+            auto const key = not_empty.prepare_wait();
+            if (try_pop_if(pred, out) == PopResult::TAKEN || stop.stop_requested()
+                || std::chrono::steady_clock::now() >= deadline) {
+                not_empty.cancel_wait();
+                break;
+            }
+            if (deadline == std::chrono::steady_clock::time_point::max()) {
+                not_empty.wait(key);
+            } else {
+                not_empty.wait_until(key, deadline);
+            }
+        }
+        if constexpr (filtered) { not_empty.remove_filtered(); }
+        return out;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        auto const tail = enqueue_pos.load(std::memory_order_relaxed);
+        auto const head = dequeue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+    [[nodiscard]] std::size_t max_size() const noexcept { return capacity; }
+
+private:
+    // Called once the dequeue index was moved past pos. A conditional pop may
+    // still be inspecting the cell, or about to from a stale index.
+    void take(Cell &cell, std::size_t pos, std::optional<Mtype> &out) {
+        for (auto seq = pos + 1;
+             !cell.seq.compare_exchange_weak(seq, s_busy, std::memory_order_acquire);
+             seq = pos + 1) {
+            if (seq == s_busy) { std::this_thread::yield(); }
+        }
+        move_out(cell, pos, out);
+    }
+
+    void move_out(Cell &cell, std::size_t pos, std::optional<Mtype> &out) {
+        out.emplace(std::move(cell.value));
+        std::destroy_at(&cell.value);
+        cell.seq.store(pos + capacity, std::memory_order_release);
+        not_full.notify_one();
+        // The dequeue index was moved by a seq_cst CAS.
+        not_empty.notify_filtered();
+    }
+
+    std::size_t capacity;
+    std::size_t mask;
+    std::unique_ptr<Cell[]> cells;  // NOLINT
+    alignas(cache_line_size) std::atomic<std::size_t> enqueue_pos{0};
+    alignas(cache_line_size) std::atomic<std::size_t> dequeue_pos{0};
+    alignas(cache_line_size) sem::EventCount not_empty{};
+    alignas(cache_line_size) sem::EventCount not_full{};
+};
+}  // namespace mq
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef ROUTED_QUEUE
+#define ROUTED_QUEUE
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mq {
+
+// TagFn for a RoutedQueue of pointer-like messages, e.g. std::unique_ptr<Base>:
+// routes them by the dynamic type of what they point to, provided Base is
+// polymorphic.
+struct TypeTag {
+    template <typename Ptr>
+        requires requires(Ptr const &msg) { typeid(*msg); }
+    std::type_index operator()(Ptr const &msg) const {
+        auto const &pointee = *msg;
+        return typeid(pointee);
+    }
+};
+
+// Queue of heterogeneous messages indexed by the tag TagFn projects, e.g. a
+// message kind or, with TypeTag, a type. Every tag has a FIFO sub-list of its
+// own, and a receiver takes messages through a Route naming the tags it
+// handles: it gets the oldest message among those tags by looking at the
+// head of each of their sub-lists only, so in O(number of tags) however many
+// messages of other tags are queued.
+// A receiver blocked on a Route sleeps on its own condition variable and a
+// message with one of its tags is moved straight to it, oldest receiver
+// first. Sub-lists are kept once created, so tags should be few.
+template <std::movable Mtype, typename TagFn>
+    requires std::regular_invocable<TagFn const &, Mtype const &>
+class RoutedQueue {
+    using Clock = std::chrono::steady_clock;
+
+    inline static constexpr std::size_t s_default_size{1000};
+    inline static constexpr Clock::time_point s_no_wait{Clock::time_point::min()};
+    inline static constexpr Clock::time_point s_forever{Clock::time_point::max()};
+
+public:
+    using value_type = Mtype;
+    using tag_type = std::remove_cvref_t<std::invoke_result_t<TagFn const &, Mtype const &>>;
+
+private:
+    struct Entry {
+        std::uint64_t seq;
+        Mtype msg;
+    };
+    using SubList = std::deque<Entry>;
+    // Elements of an unordered_map keep their address until erased, and
+    // sub-lists are never erased.
+    using SubLists = std::unordered_map<tag_type, SubList>;
+
+    struct Waiter {
+        explicit Waiter(std::vector<SubList *> const &wanted_)
+            : wanted{wanted_} {}
+
+        std::vector<SubList *> const &wanted;
+        std::optional<Mtype> msg{};
+        std::condition_variable cv{};
+        Waiter *prev{nullptr};
+        Waiter *next{nullptr};
+    };
+
+public:
+    // The set of tags one receiver handles. Cheap to copy; must not outlive
+    // the queue.
+    class Route {
+    public:
+        // Never waits: nothing if no message with one of the tags is queued.
+        std::optional<Mtype> try_dequeue() { return queue->take(wanted, s_no_wait); }
+
+        Mtype dequeue() { return *queue->take(wanted, s_forever); }
+
+        std::optional<Mtype> dequeue_until(Clock::time_point deadline) {
+            return queue->take(wanted, deadline);
+        }
+
+        template <typename Rep, typename Period>
+        std::optional<Mtype> dequeue_for(std::chrono::duration<Rep, Period> const &timeout) {
+            return dequeue_until(Clock::now() + std::chrono::ceil<Clock::duration>(timeout));
+        }
+
+        // Messages queued under the tags of this route.
+        [[nodiscard]] std::size_t size() const {
+            std::lock_guard lck{queue->mutex};
+            std::size_t n{0};
+            for (auto const *list : wanted) { n += list->size(); }
+            return n;
+        }
+
+    private:
+        friend class RoutedQueue;
+        Route(RoutedQueue &queue_, std::vector<SubList *> wanted_)
+            : queue{&queue_}
+            , wanted{std::move(wanted_)} {}
+
+        RoutedQueue *queue;
+        std::vector<SubList *> wanted;
+    };
+
+    explicit RoutedQueue(TagFn tag_of_ = {}, std::size_t max_size_ = s_default_size)
+        : tag_of{std::move(tag_of_)}
+        , capacity{max_size_} {}
+    RoutedQueue(RoutedQueue const &) = delete;
+    RoutedQueue(RoutedQueue &&) = delete;
+    RoutedQueue &operator=(RoutedQueue const &) = delete;
+    RoutedQueue &operator=(RoutedQueue &&) = delete;
+    ~RoutedQueue() = default;
+
+    // Tags named twice count once.
+    template <std::ranges::input_range Tags>
+        requires std::convertible_to<std::ranges::range_reference_t<Tags>, tag_type>
+    Route route(Tags const &tags) {
+        std::vector<SubList *> wanted{};
+        std::lock_guard lck{mutex};
+        for (auto const &tag : tags) {
+            auto *list = &lists[tag_type(tag)];
+            if (std::ranges::find(wanted, list) == wanted.end()) { wanted.push_back(list); }
+        }
+        return Route{*this, std::move(wanted)};
+    }
+    Route route(std::initializer_list<tag_type> tags) {
+        return route(std::ranges::subrange(tags.begin(), tags.end()));
+    }
+
+    // Producer side. The queue holds up to max_size messages over all tags;
+    // a message that was not accepted is left untouched.
+    bool enqueue(Mtype &&msg) { return enqueue_until(std::move(msg), s_forever); }
+
+    bool try_enqueue(Mtype &&msg) { return enqueue_until(std::move(msg), s_no_wait); }
+
+    // A message some receiver is waiting for never waits for room.
+    bool enqueue_until(Mtype &&msg, Clock::time_point deadline) {
+        std::unique_lock lck{mutex};
+        auto &list = lists[std::invoke(tag_of, std::as_const(msg))];
+        if (give(list, msg)) { return true; }
+        if (!wait_for_room(lck, deadline)) { return false; }
+        if (give(list, msg)) {
+            // The room waited for is still free for another producer.
+            not_full.notify_one();
+        } else {
+            list.push_back(Entry{next_seq++, std::move(msg)});
+            ++count;
+        }
+        return true;
+    }
+
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return try_enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        std::lock_guard lck{mutex};
+        return count;
+    }
+    [[nodiscard]] std::size_t max_size() const noexcept { return capacity; }
+    [[nodiscard]] std::size_t tag_count() const {
+        std::lock_guard lck{mutex};
+        return lists.size();
+    }
+
+private:
+    bool wait_for_room(std::unique_lock<std::mutex> &lck, Clock::time_point deadline) {
+        auto const room = [this] { return count < capacity; };
+        if (room()) { return true; }
+        if (deadline == s_no_wait) { return false; }
+        if (deadline == s_forever) {
+            not_full.wait(lck, room);
+            return true;
+        }
+        return not_full.wait_until(lck, deadline, room);
+    }
+
+    // Moves msg to the oldest receiver waiting for list, if any. A receiver
+    // only waits while all its sub-lists are empty, so this keeps every tag
+    // in order.
+    bool give(SubList &list, Mtype &msg) {
+        for (auto *w = waiters_head; w != nullptr; w = w->next) {
+            if (std::ranges::find(w->wanted, &list) != w->wanted.end()) {
+                w->msg.emplace(std::move(msg));
+                unlink(*w);
+                w->cv.notify_one();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The oldest head among the wanted sub-lists.
+    std::optional<Mtype> take(std::vector<SubList *> const &wanted, Clock::time_point deadline) {
+        std::unique_lock lck{mutex};
+        SubList *oldest{nullptr};
+        for (auto *list : wanted) {
+            if (!list->empty() && (oldest == nullptr || list->front().seq < oldest->front().seq)) {
+                oldest = list;
+            }
+        }
+        if (oldest != nullptr) {
+            std::optional<Mtype> msg{std::move(oldest->front().msg)};
+            oldest->pop_front();
+            --count;
+            lck.unlock();
+            not_full.notify_one();
+            return msg;
+        }
+        if (deadline == s_no_wait) { return {}; }
+        Waiter self{wanted};
+        link(self);
+        auto const served = [&self] { return self.msg.has_value(); };
+        if (deadline == s_forever) {
+            self.cv.wait(lck, served);
+        } else if (!self.cv.wait_until(lck, deadline, served)) {
+            unlink(self);
+        }
+        return std::move(self.msg);
+    }
+
+    void link(Waiter &w) {
+        w.prev = waiters_tail;
+        if (waiters_tail != nullptr) {
+            waiters_tail->next = &w;
+        } else {
+            waiters_head = &w;
+        }
+        waiters_tail = &w;
+    }
+
+    void unlink(Waiter &w) {
+        (w.prev != nullptr ? w.prev->next : waiters_head) = w.next;
+        (w.next != nullptr ? w.next->prev : waiters_tail) = w.prev;
+        w.prev = w.next = nullptr;
+    }
+
+    [[no_unique_address]] TagFn tag_of;
+    std::size_t capacity;
+    mutable std::mutex mutex{};
+    SubLists lists{};
+    std::size_t count{0};
+    std::uint64_t next_seq{0};
+    // Receivers blocked on a Route, oldest first.
+    Waiter *waiters_head{nullptr};
+    Waiter *waiters_tail{nullptr};
+    std::condition_variable not_full{};
+};
+}  // namespace mq
+
+#endif
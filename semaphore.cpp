@@ -1,21 +1,217 @@
 #include "semaphore.hpp"
+#include <algorithm>
+#include <climits>
+#include <ctime>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Sleeps as long as word holds expected. May return spuriously.
+void futex_wait(std::atomic<std::uint32_t> &word, std::uint32_t expected) {
+#ifdef __linux__
+    // NOLINTNEXTLINE
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    word.wait(expected, std::memory_order_relaxed);
+#endif
+}
+
+// Same as futex_wait, but gives up at deadline.
+void futex_wait_until(std::atomic<std::uint32_t> &word,
+                      std::uint32_t expected,
+                      std::chrono::steady_clock::time_point deadline) {
+    auto const left = deadline - std::chrono::steady_clock::now();
+    if (left <= std::chrono::steady_clock::duration::zero()) { return; }
+#ifdef __linux__
+    auto const secs = std::chrono::duration_cast<std::chrono::seconds>(left);
+    timespec const timeout{
+        static_cast<std::time_t>(secs.count()),
+        static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(left - secs).count())};  // NOLINT
+    // FUTEX_WAIT measures a relative timeout against CLOCK_MONOTONIC, which is
+    // what steady_clock reads on Linux.
+    // NOLINTNEXTLINE
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+#else
+    // std::atomic has no timed wait: poll instead.
+    if (word.load(std::memory_order_relaxed) == expected) { std::this_thread::yield(); }
+#endif
+}
+
+void futex_wake(std::atomic<std::uint32_t> &word, std::uint32_t n) {
+#ifdef __linux__
+    // NOLINTNEXTLINE
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE_PRIVATE, std::min<std::uint32_t>(n, INT_MAX), nullptr, nullptr, 0);
+#else
+    if (n > 1) {
+        word.notify_all();
+    } else {
+        word.notify_one();
+    }
+#endif
+}
+}  // namespace
 
 namespace sem {
 Semaphore::Semaphore(std::size_t max_slots_, std::size_t slots_ = 0)
-    : max_slots{max_slots_}
-    , slots{slots_} {
+    : max_slots{static_cast<std::uint32_t>(std::min(max_slots_, s_max_slots))}
+    , slots{static_cast<std::uint32_t>(std::min(slots_, std::size_t{max_slots}))} {
 }
+
 void Semaphore::acquire(std::mutex &ext_mutex) {
-    std::unique_lock lk{m};
-    cv.wait(lk, [&] { return slots > 0; });
-    --slots;
+    acquire();
+    ext_mutex.lock();
+}
+
+void Semaphore::acquire() {
+    auto cur = slots.load(std::memory_order_relaxed);
+    for (;;) {
+        while (cur > 0) {
+            if (slots.compare_exchange_weak(cur, cur - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        futex_wait(slots, 0);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        cur = slots.load(std::memory_order_relaxed);
+    }
+}
+
+std::size_t Semaphore::acquire_up_to(std::size_t n) {
+    if (n == 0) { return 0; }
+    auto cur = slots.load(std::memory_order_relaxed);
+    for (;;) {
+        while (cur > 0) {
+            auto const taken = static_cast<std::uint32_t>(std::min<std::size_t>(cur, n));
+            if (slots.compare_exchange_weak(cur, cur - taken, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return taken;
+            }
+        }
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        futex_wait(slots, 0);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        cur = slots.load(std::memory_order_relaxed);
+    }
+}
+
+bool Semaphore::try_acquire() {
+    auto cur = slots.load(std::memory_order_relaxed);
+    while (cur > 0) {
+        if (slots.compare_exchange_weak(cur, cur - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Semaphore::try_acquire(std::mutex &ext_mutex) {
+    if (!try_acquire()) { return false; }
+    ext_mutex.lock();
+    return true;
+}
+
+bool Semaphore::try_acquire_until(std::chrono::steady_clock::time_point deadline) {
+    auto cur = slots.load(std::memory_order_relaxed);
+    for (;;) {
+        while (cur > 0) {
+            if (slots.compare_exchange_weak(cur, cur - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        // Checked only after one more attempt, so a release that woke this
+        // thread right at the deadline is not lost.
+        if (std::chrono::steady_clock::now() >= deadline) { return false; }
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        futex_wait_until(slots, 0, deadline);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        cur = slots.load(std::memory_order_relaxed);
+    }
+}
+
+bool Semaphore::try_acquire_until(std::mutex &ext_mutex,
+                                  std::chrono::steady_clock::time_point deadline) {
+    if (!try_acquire_until(deadline)) { return false; }
     ext_mutex.lock();
+    return true;
+}
+
+std::size_t Semaphore::try_acquire_up_to(std::size_t n) {
+    if (n == 0) { return 0; }
+    auto cur = slots.load(std::memory_order_relaxed);
+    while (cur > 0) {
+        auto const taken = static_cast<std::uint32_t>(std::min<std::size_t>(cur, n));
+        if (slots.compare_exchange_weak(cur, cur - taken, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return taken;
+        }
+    }
+    return 0;
+}
+
+void Semaphore::release(std::size_t n) {
+    auto cur = slots.load(std::memory_order_relaxed);
+    std::uint32_t next{};
+    do {
+        next = static_cast<std::uint32_t>(std::min<std::size_t>(cur + n, max_slots));
+        if (next == cur) { return; }
+    } while (!slots.compare_exchange_weak(cur, next, std::memory_order_seq_cst, std::memory_order_relaxed));
+    if (waiters.load(std::memory_order_seq_cst) != 0) { futex_wake(slots, next - cur); }
+}
+
+std::uint32_t EventCount::prepare_wait() {
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return epoch.load(std::memory_order_acquire);
+}
+
+void EventCount::cancel_wait() {
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void EventCount::wait(std::uint32_t key) {
+    while (epoch.load(std::memory_order_acquire) == key) { futex_wait(epoch, key); }
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void EventCount::wait_until(std::uint32_t key,
+                            std::chrono::steady_clock::time_point deadline) {
+    while (epoch.load(std::memory_order_acquire) == key
+           && std::chrono::steady_clock::now() < deadline) {
+        futex_wait_until(epoch, key, deadline);
+    }
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void EventCount::notify_one() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Acquire, so that a filtered waiter counted in is seen registered.
+    if (waiters.load(std::memory_order_acquire) == 0) { return; }
+    epoch.fetch_add(1, std::memory_order_release);
+    futex_wake(epoch, filtered.load(std::memory_order_relaxed) == 0 ? 1 : UINT32_MAX);
+}
+
+void EventCount::notify_all() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) == 0) { return; }
+    epoch.fetch_add(1, std::memory_order_release);
+    futex_wake(epoch, UINT32_MAX);
+}
+
+void EventCount::add_filtered() {
+    filtered.fetch_add(1, std::memory_order_seq_cst);
+}
+
+void EventCount::remove_filtered() {
+    filtered.fetch_sub(1, std::memory_order_relaxed);
 }
 
-void Semaphore::release() {
-    std::unique_lock lk{m};
-    if (slots < max_slots) { ++slots; }
-    lk.unlock();
-    cv.notify_all();
+void EventCount::notify_filtered() {
+    if (filtered.load(std::memory_order_seq_cst) == 0) { return; }
+    epoch.fetch_add(1, std::memory_order_release);
+    futex_wake(epoch, UINT32_MAX);
 }
 }  // namespace sem
@@ -1,21 +1,77 @@
 #ifndef SEMAPHORE
 #define SEMAPHORE
 
-#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <mutex>
 
 namespace sem {
+// Counting semaphore on a single atomic word. Threads only sleep (on a futex,
+// where available) when no slot is left, and release wakes at most as many
+// sleepers as slots it made available.
+// The word is 32 bits wide: counts above s_max_slots are clamped to it.
 class Semaphore {
 public:
+    inline static constexpr std::size_t s_max_slots{std::numeric_limits<std::uint32_t>::max()};
+
     Semaphore(std::size_t max_slots_, std::size_t slots_);
     void acquire(std::mutex &);
-    void release();
+    void acquire();
+    // Waits for at least one slot, then takes as many as are available, up
+    // to n. Returns how many were taken.
+    std::size_t acquire_up_to(std::size_t n);
+    [[nodiscard]] bool try_acquire();
+    // Locks the mutex only if a slot was taken.
+    [[nodiscard]] bool try_acquire(std::mutex &);
+    // Waits for a slot no later than deadline.
+    [[nodiscard]] bool try_acquire_until(std::chrono::steady_clock::time_point deadline);
+    [[nodiscard]] bool try_acquire_until(std::mutex &, std::chrono::steady_clock::time_point deadline);
+    // Same as acquire_up_to, but returns 0 instead of waiting.
+    [[nodiscard]] std::size_t try_acquire_up_to(std::size_t n);
+    void release(std::size_t n = 1);
+    // Only a snapshot: other threads may change it right away.
+    [[nodiscard]] std::size_t available() const noexcept {
+        return slots.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::uint32_t max_slots;
+    std::atomic<std::uint32_t> slots;
+    std::atomic<std::uint32_t> waiters{0};
+};
+
+// Lets lock-free structures block only on their slow path. A waiter calls
+// prepare_wait(), re-checks its condition and then either cancel_wait() or
+// wait(key); the side that changes the condition calls notify_*() afterwards,
+// which costs a fence and a load while nobody is waiting.
+class EventCount {
+public:
+    [[nodiscard]] std::uint32_t prepare_wait();
+    void cancel_wait();
+    void wait(std::uint32_t key);
+    // Returns at deadline even if nobody called notify_*(), so the caller
+    // must re-check its condition either way.
+    void wait_until(std::uint32_t key, std::chrono::steady_clock::time_point deadline);
+    void notify_one();
+    void notify_all();
+
+    // A waiter testing a predicate may reject what another waiter would
+    // accept, so it registers around its waits: while one is registered,
+    // notify_one() wakes everybody.
+    void add_filtered();
+    void remove_filtered();
+    // Wakes everybody if a filtered waiter is registered, e.g. because a
+    // head it rejected was taken. Costs a load only: the change must have
+    // been made by a seq_cst operation that the waiter re-checks.
+    void notify_filtered();
 
 private:
-    std::size_t max_slots;
-    std::size_t slots;
-    std::condition_variable cv{};
-    std::mutex m{};
+    std::atomic<std::uint32_t> epoch{0};
+    std::atomic<std::uint32_t> waiters{0};
+    std::atomic<std::uint32_t> filtered{0};
 };
 }  // namespace sem
 #endif
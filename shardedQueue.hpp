@@ -0,0 +1,284 @@
+#ifndef SHARDED_QUEUE
+#define SHARDED_QUEUE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "messageQueue.hpp"
+#include "ringBuffer.hpp"
+#include "semaphore.hpp"
+
+namespace mq {
+
+// KeyFn for a ShardedQueue whose producers each stick to a shard of their own.
+struct ThreadAffinity {};
+
+// How receivers of a ShardedQueue pick the shard they look at first.
+// ROUND_ROBIN spreads consecutive dequeues over all shards, WORK_STEALING
+// gives every receiver thread a home shard and only visits the others when it
+// is empty.
+enum class Drain {
+    ROUND_ROBIN,
+    WORK_STEALING,
+};
+
+namespace detail {
+// Small dense number for the calling thread, handed out on first use.
+inline std::size_t thread_index() {
+    static std::atomic<std::size_t> next{0};
+    thread_local std::size_t const index{next.fetch_add(1, std::memory_order_relaxed)};
+    return index;
+}
+}  // namespace detail
+
+// Spreads messages over independent FIFO sub-queues, each with its own mutex
+// and semaphores, so that producers on different shards never contend.
+// With KeyFn = ThreadAffinity each producer thread always uses the same
+// shard; otherwise the shard is picked by hashing the key KeyFn projects, so
+// that messages with equal keys share a shard and keep their order. Receivers
+// look at every shard before going to sleep.
+// Ordering holds within a shard only: there is no order across shards.
+template <std::movable Mtype, typename KeyFn = ThreadAffinity>
+    requires std::same_as<KeyFn, ThreadAffinity>
+             || std::regular_invocable<KeyFn const &, Mtype const &>
+class ShardedQueue {
+    using Clock = std::chrono::steady_clock;
+    using Shard = Queue<Mtype, Fifo, std::deque<Mtype>>;
+
+    inline static constexpr std::size_t s_default_size{1000};
+
+    struct alignas(cache_line_size) Slot {
+        Slot(std::size_t size, Overflow overflow)
+            : queue{std::deque<Mtype>{}, size, overflow} {}
+
+        Shard queue;
+    };
+
+public:
+    using value_type = Mtype;
+
+    // Every shard holds up to shard_size messages. The default is one shard
+    // per hardware thread.
+    explicit ShardedQueue(KeyFn key_of_ = {},
+                          std::size_t shard_count = std::max(std::thread::hardware_concurrency(), 1U),
+                          std::size_t shard_size = s_default_size,
+                          Drain drain_ = Drain::ROUND_ROBIN,
+                          Overflow overflow = Overflow::BLOCK)
+        : key_of{std::move(key_of_)}
+        , drain{drain_} {
+        for (std::size_t i = 0; i < std::max(shard_count, std::size_t{1}); ++i) {
+            shards.emplace_back(shard_size, overflow);
+        }
+    }
+
+    // Producer side: the message only ever waits for room in its own shard.
+    bool enqueue(Mtype &&msg) {
+        return notified(shard_for(msg).enqueue(std::move(msg)));
+    }
+
+    bool try_enqueue(Mtype &&msg) {
+        return notified(shard_for(msg).try_enqueue(std::move(msg)));
+    }
+
+    bool enqueue_until(Mtype &&msg, Clock::time_point deadline) {
+        return notified(shard_for(msg).enqueue_until(std::move(msg), deadline));
+    }
+
+    // The shard is only known once the message exists, so it is built first
+    // and then moved in.
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return try_enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    // Waits for room for the first message only, and wakes receivers once:
+    // one receiver for one message, all of them for more.
+    // Each message is only moved once its shard accepts it: the rest are left
+    // untouched.
+    template <std::forward_iterator It, std::sentinel_for<It> Sentinel>
+    std::size_t enqueue_bulk(It first, Sentinel last)
+        requires std::constructible_from<Mtype, std::iter_rvalue_reference_t<It>>
+    {
+        if (first == last) { return 0; }
+        if (!shard_for(*first).emplace(std::ranges::iter_move(first))) { return 0; }
+        std::size_t accepted{1};
+        for (++first; first != last; ++first, ++accepted) {
+            if (!shard_for(*first).try_emplace(std::ranges::iter_move(first))) { break; }
+        }
+        if (accepted == 1) {
+            not_empty.notify_one();
+        } else {
+            not_empty.notify_all();
+        }
+        return accepted;
+    }
+
+    // Consumer side. Returns nothing if every shard is empty, or if the
+    // first non-empty head found is rejected by pred.
+    std::optional<Mtype>
+    try_dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::optional<Mtype> msg{};
+        take_first_head_if(pred, msg);
+        return msg;
+    }
+
+    // Blocks while every shard is empty.
+    std::optional<Mtype>
+    dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::optional<Mtype> msg{};
+        while (!take_first_head_if(pred, msg)) {
+            auto const key = not_empty.prepare_wait();
+            if (take_first_head_if(pred, msg)) {
+                not_empty.cancel_wait();
+                break;
+            }
+            not_empty.wait(key);
+        }
+        return msg;
+    }
+
+    // Waits for a message accepted by pred at the head of any shard. Heads
+    // are re-checked whenever a message arrives or a head is taken. A stop
+    // request on stop gives up waiting too.
+    // Other receivers are woken one per message while no such waiter is
+    // parked.
+    std::optional<Mtype>
+    dequeue_wait_if(std::predicate<Mtype const &> auto const &pred,
+                    Clock::time_point deadline,
+                    std::stop_token const &stop = {}) {
+        std::optional<Mtype> msg{};
+        if (take_any_if(pred, msg)) { return msg; }
+        std::stop_callback const on_stop{stop, [this] { not_empty.notify_all(); }};
+        not_empty.add_filtered();
+        for (;;) {
+            auto const key = not_empty.prepare_wait();
+            if (take_any_if(pred, msg) || stop.stop_requested() || Clock::now() >= deadline) {
+                not_empty.cancel_wait();
+                break;
+            }
+            if (deadline == Clock::time_point::max()) {
+                not_empty.wait(key);
+            } else {
+                not_empty.wait_until(key, deadline);
+            }
+        }
+        not_empty.remove_filtered();
+        return msg;
+    }
+
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t dequeue_bulk_if(OutputIt out,
+                                std::size_t max_n,
+                                std::predicate<Mtype const &> auto const &pred) {
+        if (max_n == 0) { return 0; }
+        auto first = dequeue_if(pred);
+        if (!first) { return 0; }
+        *out = std::move(*first);
+        return 1 + drain_if(++out, max_n - 1, pred);
+    }
+
+    // Drains the shards one after the other, each under a single lock,
+    // starting from the one drain picks.
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t drain_if(OutputIt out,
+                         std::size_t max_n,
+                         std::predicate<Mtype const &> auto const &pred) {
+        std::size_t taken{0};
+        auto const start = first_shard();
+        for (std::size_t i = 0; i < shards.size() && taken < max_n; ++i) {
+            auto const n = shard(start + i).drain_if(out, max_n - taken, pred);
+            std::ranges::advance(out, static_cast<std::ptrdiff_t>(n));
+            taken += n;
+        }
+        if (taken > 0) { head_taken(); }
+        return taken;
+    }
+
+    [[nodiscard]] std::size_t shard_count() const noexcept { return shards.size(); }
+
+private:
+    Shard &shard(std::size_t i) { return shards[i % shards.size()].queue; }
+
+    Shard &shard_for(Mtype const &msg) {
+        if constexpr (std::same_as<KeyFn, ThreadAffinity>) {
+            return shard(detail::thread_index());
+        } else {
+            using Key = std::remove_cvref_t<std::invoke_result_t<KeyFn const &, Mtype const &>>;
+            return shard(std::hash<Key>{}(std::invoke(key_of, msg)));
+        }
+    }
+
+    bool notified(bool accepted) {
+        if (accepted) { not_empty.notify_one(); }
+        return accepted;
+    }
+
+    // The shard mutex the pop released orders it before this load, against
+    // the re-check of dequeue_wait_if that locks it.
+    void head_taken() { not_empty.notify_filtered(); }
+
+    std::size_t first_shard() {
+        if (drain == Drain::WORK_STEALING) { return detail::thread_index(); }
+        return cursor.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Tests the head of the first non-empty shard only. Returns false if
+    // every shard was empty.
+    bool take_first_head_if(std::predicate<Mtype const &> auto const &pred,
+                            std::optional<Mtype> &out) {
+        auto const start = first_shard();
+        for (std::size_t i = 0; i < shards.size(); ++i) {
+            bool seen{false};
+            out = shard(start + i).try_dequeue_if([&pred, &seen](Mtype const &msg) {
+                seen = true;
+                return std::invoke(pred, msg);
+            });
+            if (out) { head_taken(); }
+            if (seen) { return true; }
+        }
+        return false;
+    }
+
+    // Skips heads rejected by pred.
+    bool take_any_if(std::predicate<Mtype const &> auto const &pred,
+                     std::optional<Mtype> &out) {
+        auto const start = first_shard();
+        for (std::size_t i = 0; i < shards.size(); ++i) {
+            out = shard(start + i).try_dequeue_if(pred);
+            if (out) {
+                head_taken();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    [[no_unique_address]] KeyFn key_of;
+    Drain drain;
+    std::deque<Slot> shards{};
+    alignas(cache_line_size) std::atomic<std::size_t> cursor{0};
+    alignas(cache_line_size) sem::EventCount not_empty{};
+};
+}  // namespace mq
+
+#endif
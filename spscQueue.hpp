@@ -0,0 +1,311 @@
+#ifndef SPSC_QUEUE
+#define SPSC_QUEUE
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <utility>
+
+#include "messageQueue.hpp"
+#include "ringBuffer.hpp"
+#include "semaphore.hpp"
+
+namespace mq {
+
+// Single-producer/single-consumer queue. Each side owns one index and keeps a
+// cached copy of the other one, so the hot path is a plain load and a release
+// store: the shared index is only re-read when the cached copy says the queue
+// is full (producer) or empty (consumer).
+// Exactly one thread may enqueue and exactly one thread may dequeue.
+// The capacity is rounded up to a power of two.
+template <std::movable Mtype>
+class SpscQueue {
+    struct Slot {
+        Slot() {}  // NOLINT
+        Slot(Slot const &) = delete;
+        Slot(Slot &&) = delete;
+        Slot &operator=(Slot const &) = delete;
+        Slot &operator=(Slot &&) = delete;
+        ~Slot() {}  // NOLINT
+
+        union {
+            Mtype value;
+        };
+    };
+
+    inline static constexpr std::size_t s_default_size{1000};
+    // Polls before parking, so a consumer that keeps up with its producer
+    // never pays for a futex wake-up.
+    inline static constexpr int s_spin_count{128};
+
+public:
+    using value_type = Mtype;
+
+    explicit SpscQueue(std::size_t max_size_ = s_default_size)
+        : capacity{std::bit_ceil(max_size_ == 0 ? std::size_t{1} : max_size_)}
+        , mask{capacity - 1}
+        , slots{std::make_unique<Slot[]>(capacity)} {}  // NOLINT
+    SpscQueue(SpscQueue const &) = delete;
+    SpscQueue(SpscQueue &&) = delete;
+    SpscQueue &operator=(SpscQueue const &) = delete;
+    SpscQueue &operator=(SpscQueue &&) = delete;
+    ~SpscQueue() {
+        auto const last = tail.load(std::memory_order_relaxed);
+        for (auto pos = head.load(std::memory_order_relaxed); pos != last; ++pos) {
+            std::destroy_at(&slots[pos & mask].value);
+        }
+    }
+
+    // Producer side. The message is constructed straight into its slot, so
+    // args are left untouched when the queue is full.
+    bool try_enqueue(Mtype &&msg) { return try_emplace(std::move(msg)); }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args) {
+        auto const pos = tail.load(std::memory_order_relaxed);
+        if (pos - cached_head == capacity) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (pos - cached_head == capacity) { return false; }
+        }
+        std::construct_at(&slots[pos & mask].value, std::forward<Args>(args)...);
+        tail.store(pos + 1, std::memory_order_release);
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool enqueue(Mtype &&msg) { return emplace(std::move(msg)); }
+
+    template <typename... Args>
+    bool emplace(Args &&...args) {
+        for (int i = 0; i < s_spin_count; ++i) {
+            if (try_emplace(std::forward<Args>(args)...)) { return true; }  // NOLINT
+        }
+        while (!try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+            auto const key = not_full.prepare_wait();
+            if (try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+                not_full.cancel_wait();
+                break;
+            }
+            not_full.wait(key);
+        }
+        return true;
+    }
+
+    bool enqueue_until(Mtype &&msg, std::chrono::steady_clock::time_point deadline) {
+        return emplace_until(deadline, std::move(msg));
+    }
+
+    // Gives up at deadline, leaving args untouched.
+    template <typename... Args>
+    bool emplace_until(std::chrono::steady_clock::time_point deadline, Args &&...args) {
+        for (int i = 0; i < s_spin_count; ++i) {
+            if (try_emplace(std::forward<Args>(args)...)) { return true; }  // NOLINT
+        }
+        while (!try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+            if (std::chrono::steady_clock::now() >= deadline) { return false; }
+            auto const key = not_full.prepare_wait();
+            if (try_emplace(std::forward<Args>(args)...)) {  // NOLINT
+                not_full.cancel_wait();
+                break;
+            }
+            not_full.wait_until(key, deadline);
+        }
+        return true;
+    }
+
+    // Waits for room for at least one message, then constructs as many of
+    // [first, last) as fit and publishes them with a single store.
+    // Returns how many messages were accepted.
+    template <std::forward_iterator It, std::sentinel_for<It> Sentinel>
+    std::size_t enqueue_bulk(It first, Sentinel last)
+        requires std::constructible_from<Mtype, std::iter_rvalue_reference_t<It>>
+    {
+        if (first == last) { return 0; }
+        auto const pos = tail.load(std::memory_order_relaxed);
+        auto const refresh = [&] {
+            cached_head = head.load(std::memory_order_acquire);
+            return capacity - (pos - cached_head);
+        };
+        auto room = refresh();
+        for (int i = 0; room == 0; ++i) {
+            if (i < s_spin_count) {
+                room = refresh();
+                continue;
+            }
+            auto const key = not_full.prepare_wait();
+            room = refresh();
+            if (room == 0) {
+                not_full.wait(key);
+                room = refresh();
+            } else {
+                not_full.cancel_wait();
+            }
+        }
+        std::size_t accepted{0};
+        for (; accepted < room && first != last; ++accepted, ++first) {
+            std::construct_at(&slots[(pos + accepted) & mask].value, std::ranges::iter_move(first));
+        }
+        tail.store(pos + accepted, std::memory_order_release);
+        not_empty.notify_one();
+        return accepted;
+    }
+
+    // Consumer side. Returns nothing if the queue is empty or the head
+    // element is rejected by pred.
+    std::optional<Mtype>
+    try_dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::optional<Mtype> out{};
+        pop_head_if(pred, out);
+        return out;
+    }
+
+    // Blocks while the queue is empty, then tests the head element only.
+    std::optional<Mtype>
+    dequeue_if(std::predicate<Mtype const &> auto const &pred) {
+        std::optional<Mtype> out{};
+        for (int i = 0; i < s_spin_count; ++i) {
+            if (pop_head_if(pred, out)) { return out; }
+        }
+        while (!pop_head_if(pred, out)) {
+            auto const key = not_empty.prepare_wait();
+            if (pop_head_if(pred, out)) {
+                not_empty.cancel_wait();
+                break;
+            }
+            not_empty.wait(key);
+        }
+        return out;
+    }
+
+    // Waits until the head element satisfies pred, the deadline expires or
+    // a stop is requested on stop. Only the consumer can take a rejected
+    // head, so it is tested again as messages arrive but stays until then.
+    std::optional<Mtype>
+    dequeue_wait_if(std::predicate<Mtype const &> auto const &pred,
+                    std::chrono::steady_clock::time_point deadline,
+                    std::stop_token const &stop = {}) {
+        std::optional<Mtype> out{};
+        auto const taken = [&] { return pop_head_if(pred, out) && out.has_value(); };
+        for (int i = 0; i < s_spin_count; ++i) {
+            if (taken()) { return out; }
+        }
+        std::stop_callback const on_stop{stop, [this] { not_empty.notify_all(); }};
+        while (!taken()) {
+            auto const key = not_empty.prepare_wait();
+            if (taken() || stop.stop_requested() || std::chrono::steady_clock::now() >= deadline) {
+                not_empty.cancel_wait();
+                break;
+            }
+            if (deadline == std::chrono::steady_clock::time_point::max()) {
+                not_empty.wait(key);
+            } else {
+                not_empty.wait_until(key, deadline);
+            }
+        }
+        return out;
+    }
+
+    // Waits for at least one message, then moves up to max_n messages to out
+    // and frees their slots with a single store, stopping at the first head
+    // rejected by pred. Returns how many messages were moved.
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t dequeue_bulk_if(OutputIt out,
+                                std::size_t max_n,
+                                std::predicate<Mtype const &> auto const &pred) {
+        if (max_n == 0) { return 0; }
+        for (int i = 0; i < s_spin_count; ++i) {
+            if (head.load(std::memory_order_relaxed) != refresh_tail()) {
+                return drain_if(std::move(out), max_n, pred);
+            }
+        }
+        while (head.load(std::memory_order_relaxed) == refresh_tail()) {
+            auto const key = not_empty.prepare_wait();
+            if (head.load(std::memory_order_relaxed) != refresh_tail()) {
+                not_empty.cancel_wait();
+                break;
+            }
+            not_empty.wait(key);
+        }
+        return drain_if(std::move(out), max_n, pred);
+    }
+
+    // Same as dequeue_bulk_if, but returns 0 instead of waiting when the
+    // queue is empty.
+    template <std::output_iterator<Mtype> OutputIt>
+    std::size_t drain_if(OutputIt out,
+                         std::size_t max_n,
+                         std::predicate<Mtype const &> auto const &pred) {
+        auto const pos = head.load(std::memory_order_relaxed);
+        auto const available = std::min(refresh_tail() - pos, max_n);
+        std::size_t taken{0};
+        for (; taken < available; ++taken, ++out) {
+            auto &value = slots[(pos + taken) & mask].value;
+            if (!std::invoke(pred, std::as_const(value))) { break; }
+            *out = std::move(value);
+            std::destroy_at(&value);
+        }
+        if (taken > 0) {
+            head.store(pos + taken, std::memory_order_release);
+            not_full.notify_one();
+        }
+        return taken;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return tail.load(std::memory_order_relaxed)
+             - head.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] std::size_t max_size() const noexcept { return capacity; }
+
+private:
+    std::size_t refresh_tail() {
+        cached_tail = tail.load(std::memory_order_acquire);
+        return cached_tail;
+    }
+
+    // Returns false only if the queue is empty.
+    bool pop_head_if(std::predicate<Mtype const &> auto const &pred,
+                     std::optional<Mtype> &out) {
+        auto const pos = head.load(std::memory_order_relaxed);
+        if (pos == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (pos == cached_tail) { return false; }
+        }
+        auto &value = slots[pos & mask].value;
+        if (std::invoke(pred, std::as_const(value))) {
+            out.emplace(std::move(value));
+            std::destroy_at(&value);
+            head.store(pos + 1, std::memory_order_release);
+            not_full.notify_one();
+        }
+        return true;
+    }
+
+    std::size_t capacity;
+    std::size_t mask;
+    std::unique_ptr<Slot[]> slots;  // NOLINT
+    alignas(cache_line_size) std::atomic<std::size_t> tail{0};
+    std::size_t cached_head{0};
+    alignas(cache_line_size) std::atomic<std::size_t> head{0};
+    std::size_t cached_tail{0};
+    alignas(cache_line_size) sem::EventCount not_empty{};
+    alignas(cache_line_size) sem::EventCount not_full{};
+};
+
+// The only Producer/Receiver couple that may be attached to q.
+template <std::movable Mtype>
+std::pair<Producer<Mtype, SpscQueue<Mtype>>, Receiver<Mtype, SpscQueue<Mtype>>>
+endpoints(SpscQueue<Mtype> &q) {
+    return {Producer{q}, Receiver{q}};
+}
+}  // namespace mq
+
+#endif
@@ -0,0 +1,73 @@
+/*
+
+    Test for mq::Dispatcher with messages no subscription accepts.
+    Unmatched messages sit ahead of matched ones in a FIFO queue; every
+    matched message must still reach its handler, and every unmatched one
+    the dead-letter handler. Exits with a non-zero status on failure.
+
+*/
+
+#include "../dispatcher.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <thread>
+
+namespace {
+constexpr auto time_limit{std::chrono::seconds{10}};
+
+bool wait_for(std::atomic<int> const &counter, int expected) {
+    auto const deadline = std::chrono::steady_clock::now() + time_limit;
+    while (counter.load() < expected) {
+        if (std::chrono::steady_clock::now() >= deadline) { return false; }
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return true;
+}
+
+// 0..59 with subscriptions for multiples of 2 and of 3: 40 matched, 20 not.
+bool two_subscriptions() {
+    mq::Queue<int> queue{std::deque<int>{}, 8};
+    std::atomic<int> handled{0};
+    std::atomic<int> unmatched{0};
+    mq::Dispatcher dispatcher{queue, 3};
+    dispatcher.subscribe([](int const &v) { return v % 2 == 0; }, [&handled](int &&) { ++handled; });
+    dispatcher.subscribe([](int const &v) { return v % 3 == 0; }, [&handled](int &&) { ++handled; });
+    dispatcher.on_unmatched([&unmatched](int &&) { ++unmatched; });
+    dispatcher.start();
+    for (int i = 0; i < 60; ++i) { queue.enqueue(int{i}); }
+    bool const ok = wait_for(handled, 40) && wait_for(unmatched, 20);
+    dispatcher.stop();
+    if (!ok || dispatcher.unmatched_count() != 20) {
+        std::fprintf(stderr, "two subscriptions: handled %d, unmatched %d\n", handled.load(), unmatched.load());
+        return false;
+    }
+    return true;
+}
+
+// Message 7 is queued before 8..19 and nobody wants it; without a
+// dead-letter handler it is dropped and counted.
+bool dropped_head() {
+    mq::Queue<int> queue{std::deque<int>{}, 4};
+    std::atomic<int> handled{0};
+    mq::Dispatcher dispatcher{queue, 2};
+    dispatcher.subscribe([](int const &v) { return v != 7; }, [&handled](int &&) { ++handled; });
+    dispatcher.start();
+    for (int i = 0; i < 20; ++i) { queue.enqueue(int{i}); }
+    bool const ok = wait_for(handled, 19);
+    dispatcher.stop();
+    if (!ok || dispatcher.unmatched_count() != 1) {
+        std::fprintf(stderr, "dropped head: handled %d, unmatched %zu\n", handled.load(),
+                     dispatcher.unmatched_count());
+        return false;
+    }
+    return true;
+}
+}  // namespace
+
+int main() {
+    bool const ok = two_subscriptions() && dropped_head();
+    std::puts(ok ? "dispatcher_unmatched: ok" : "dispatcher_unmatched: FAILED");
+    return ok ? 0 : 1;
+}
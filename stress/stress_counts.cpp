@@ -0,0 +1,182 @@
+/*
+
+    Stress test for the semaphore accounting of mq::Queue.
+    Producers and consumers hammer a small queue with every kind of call,
+    including receives that find the queue empty or the head rejected, while
+    a monitor checks that the semaphores never disagree with the container.
+    Exits with a non-zero status on failure.
+
+*/
+
+#include "../messageQueue.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iterator>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr std::size_t queue_size{8};
+constexpr int producers{3};
+constexpr int consumers{3};
+constexpr int per_producer{20000};
+constexpr int poison{-1};
+
+struct Totals {
+    std::atomic<std::int64_t> sum{0};
+    std::atomic<std::int64_t> count{0};
+    std::atomic<std::int64_t> rejected{0};
+    std::atomic<std::int64_t> empty{0};
+};
+
+void produce(mq::Queue<int> &queue, int id) {
+    mq::Producer producer{queue};
+    int const first{id * per_producer + 1};
+    int const last{first + per_producer};
+    for (int v = first; v < last;) {
+        switch (v % 4) {
+        case 0:
+            producer.enqueue(int{v++});
+            break;
+        case 1:
+            if (producer.try_enqueue(int{v})) { ++v; }
+            break;
+        case 2:
+            if (producer.enqueue_for(int{v}, std::chrono::microseconds{50})) { ++v; }
+            break;
+        default: {
+            std::array<int, 3> burst{v, v + 1, v + 2};
+            auto const n = std::min<std::ptrdiff_t>(3, last - v);
+            v += static_cast<int>(producer.enqueue_bulk(burst.begin(), burst.begin() + n));
+            break;
+        }
+        }
+    }
+}
+
+// Returns false once it took a poison message.
+bool account(std::optional<int> const &msg, Totals &totals) {
+    if (!msg) { return true; }
+    if (*msg == poison) { return false; }
+    totals.sum += *msg;
+    ++totals.count;
+    return true;
+}
+
+void consume(mq::Queue<int> &queue, Totals &totals, std::atomic<int> &finished) {
+    mq::Receiver receiver{queue};
+    auto const any = [](int const &) { return true; };
+    // Rejects about half the heads, never a poison message.
+    auto const even = [](int const &v) { return v % 2 == 0 || v == poison; };
+    for (unsigned round = 0;; ++round) {
+        bool alive{true};
+        switch (round % 6) {
+        case 0: {
+            auto msg = receiver.dequeue_if(even);
+            if (!msg) { ++totals.rejected; }
+            alive = account(msg, totals);
+            break;
+        }
+        case 1: {
+            auto msg = receiver.try_dequeue_if(any);
+            if (!msg) { ++totals.empty; }
+            alive = account(msg, totals);
+            break;
+        }
+        case 2:
+            alive = account(receiver.dequeue_first_if(even, 4), totals);
+            break;
+        case 3:
+        case 4: {
+            std::vector<int> batch{};
+            if (round % 6 == 3) {
+                receiver.dequeue_bulk(std::back_inserter(batch), 4);
+            } else {
+                receiver.drain_into(batch);
+            }
+            for (auto v : batch) { alive = account(v, totals) && alive; }
+            break;
+        }
+        default:
+            alive = account(queue.dequeue_wait_if(
+                                any, std::chrono::steady_clock::now() + std::chrono::microseconds{100}),
+                            totals);
+            break;
+        }
+        if (!alive) {
+            ++finished;
+            return;
+        }
+    }
+}
+}  // namespace
+
+int main() {
+    mq::Queue queue{std::deque<int>{}, queue_size};
+    Totals totals{};
+    std::atomic<bool> done{false};
+    std::atomic<std::int64_t> checks{0};
+    std::atomic<std::int64_t> violations{0};
+
+    std::thread monitor{[&] {
+        while (!done.load()) {
+            if (!queue.counts_consistent()) { ++violations; }
+            ++checks;
+        }
+    }};
+    std::atomic<int> finished{0};
+    std::vector<std::thread> threads{};
+    for (int i = 0; i < consumers; ++i) {
+        threads.emplace_back([&] { consume(queue, totals, finished); });
+    }
+    {
+        std::vector<std::thread> producing{};
+        for (int i = 0; i < producers; ++i) {
+            producing.emplace_back([&queue, i] { produce(queue, i); });
+        }
+        for (auto &t : producing) { t.join(); }
+    }
+    // Consumers may be waiting for a message: feed poison until all are gone.
+    while (finished.load() < consumers) {
+        queue.try_enqueue(int{poison});
+        std::this_thread::sleep_for(std::chrono::microseconds{100});
+    }
+    for (auto &t : threads) { t.join(); }
+    done = true;
+    monitor.join();
+
+    bool ok{violations.load() == 0};
+    // Whatever is left is poison; once drained, an idle queue must take
+    // exactly queue_size messages and give back exactly as many.
+    std::vector<int> left{};
+    queue.drain_if(std::back_inserter(left), queue_size, [](int const &) { return true; });
+    for (auto v : left) { ok = ok && v == poison; }
+    for (std::size_t i = 0; i < queue_size; ++i) { ok = queue.try_enqueue(static_cast<int>(i)) && ok; }
+    ok = !queue.try_enqueue(0) && ok;
+    left.clear();
+    ok = queue.drain_if(std::back_inserter(left), queue_size + 1, [](int const &) { return true; }) == queue_size
+         && ok;
+    ok = !queue.try_dequeue_if([](int const &) { return true; }) && ok;
+
+    std::int64_t const expected_count{static_cast<std::int64_t>(producers) * per_producer};
+    std::int64_t const expected_sum{expected_count * (expected_count + 1) / 2};
+    ok = ok && totals.count.load() == expected_count && totals.sum.load() == expected_sum;
+
+    std::printf("%s: %" PRId64 " messages, %" PRId64 " rejected heads, %" PRId64 " empty receives, "
+                "%" PRId64 " checks, %" PRId64 " violations\n",
+                ok ? "PASS" : "FAIL",
+                totals.count.load(),
+                totals.rejected.load(),
+                totals.empty.load(),
+                checks.load(),
+                violations.load());
+    return ok ? 0 : 1;
+}
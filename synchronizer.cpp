@@ -10,8 +10,33 @@ Synchronizer::Synchronizer(sem::Semaphore &sem_a_,
     sem_a.acquire(m_);
 }
 
+Synchronizer::Synchronizer(sem::Semaphore &sem_a_,
+                           sem::Semaphore &sem_b_,
+                           std::mutex &m_,
+                           std::try_to_lock_t)
+    : sem_a{sem_a_}
+    , sem_b{sem_b_}
+    , mtx{m_}
+    , acquired{sem_a.try_acquire(m_)} {
+}
+
+Synchronizer::Synchronizer(sem::Semaphore &sem_a_,
+                           sem::Semaphore &sem_b_,
+                           std::mutex &m_,
+                           std::chrono::steady_clock::time_point deadline)
+    : sem_a{sem_a_}
+    , sem_b{sem_b_}
+    , mtx{m_}
+    , acquired{sem_a.try_acquire_until(m_, deadline)} {
+}
+
 Synchronizer::~Synchronizer() {
+    if (!acquired) { return; }
     mtx.unlock();
-    sem_b.release();
+    if (rolled_back) {
+        sem_a.release();
+    } else {
+        sem_b.release();
+    }
 }
 }  // namespace synch
@@ -2,6 +2,7 @@
 #define SYNCHRONIZER
 
 #include "semaphore.hpp"
+#include <chrono>
 #include <mutex>
 
 namespace synch {
@@ -12,12 +13,28 @@ public:
     Synchronizer &operator=(Synchronizer const &) = delete;
     Synchronizer &operator=(Synchronizer &&) = delete;
     Synchronizer(sem::Semaphore &sem_a_, sem::Semaphore &sem_b_, std::mutex &m_);
+    // Never waits for sem_a. If no slot is available the mutex is not
+    // locked, owns_slot() is false and destruction does nothing.
+    Synchronizer(sem::Semaphore &sem_a_, sem::Semaphore &sem_b_, std::mutex &m_, std::try_to_lock_t);
+    // Same, but waits for sem_a until deadline.
+    Synchronizer(sem::Semaphore &sem_a_,
+                 sem::Semaphore &sem_b_,
+                 std::mutex &m_,
+                 std::chrono::steady_clock::time_point deadline);
     ~Synchronizer();
 
+    [[nodiscard]] bool owns_slot() const noexcept { return acquired; }
+
+    // Hands the slot taken from sem_a back to it on destruction, instead of
+    // releasing sem_b.
+    void rollback() noexcept { rolled_back = true; }
+
 private:
     // NOLINTNEXTLINE
     sem::Semaphore &sem_a, &sem_b;
     std::mutex &mtx;
+    bool acquired{true};
+    bool rolled_back{false};
 };
 }  // namespace synch
 #endif
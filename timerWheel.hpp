@@ -0,0 +1,237 @@
+#ifndef TIMER_WHEEL
+#define TIMER_WHEEL
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mq {
+
+// Hierarchical timing wheel holding messages until their tick comes. Four
+// levels of 256 slots each cover 2^32 ticks; a timer goes to the lowest level
+// whose span reaches it, so inserting is a push_back and every timer is
+// cascaded at most once per level on its way down. Timers past the last
+// level wait in it and are placed again each time it comes around.
+// Stretches of ticks on which nothing can fire are skipped whole.
+// Not thread-safe: see DelayLine.
+template <std::movable Mtype>
+class TimerWheel {
+    inline static constexpr std::size_t s_slot_bits{8};
+    inline static constexpr std::size_t s_slots{std::size_t{1} << s_slot_bits};
+    inline static constexpr std::size_t s_levels{4};
+
+    struct Timer {
+        std::uint64_t due;
+        Mtype msg;
+    };
+    using Slot = std::vector<Timer>;
+
+public:
+    void insert(std::uint64_t due, Mtype &&msg) {
+        place(Timer{due, std::move(msg)});
+        ++count;
+    }
+
+    // Moves the wheel forward to tick, handing every message due by then to
+    // fire.
+    template <std::invocable<Mtype &&> Fire>
+    void advance(std::uint64_t tick, Fire const &fire) {
+        fire_expired(fire);
+        while (now < tick) {
+            // With the lowest levels empty, nothing happens before the next
+            // cascade from the first level in use.
+            std::size_t quiet{0};
+            while (quiet < s_levels && per_level[quiet] == 0) { ++quiet; }
+            if (quiet == s_levels) {
+                now = tick;
+                break;
+            }
+            if (quiet > 0) {
+                now = std::min(now | (span(quiet) - 1), tick);
+                if (now == tick) { break; }
+            }
+            ++now;
+            for (std::size_t level = 1; level < s_levels && digit(now, level - 1) == 0; ++level) {
+                replace(level, digit(now, level));
+            }
+            replace(0, digit(now, 0));
+            fire_expired(fire);
+        }
+    }
+
+    // Earliest tick at which advance may fire something, nothing if the
+    // wheel is empty. Timers on the upper levels only give a lower bound:
+    // the next time level 0 wraps around.
+    [[nodiscard]] std::optional<std::uint64_t> next_expiry() const {
+        if (count == 0) { return {}; }
+        if (!expired.empty()) { return now; }
+        auto const wrap = (now | (s_slots - 1)) + 1;
+        for (auto tick = now + 1; tick < wrap; ++tick) {
+            if (!slots[0][digit(tick, 0)].empty()) { return tick; }
+        }
+        return wrap;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return count; }
+    [[nodiscard]] bool empty() const noexcept { return count == 0; }
+
+private:
+    [[nodiscard]] static constexpr std::uint64_t span(std::size_t level) noexcept {
+        return std::uint64_t{1} << (s_slot_bits * level);
+    }
+    [[nodiscard]] static constexpr std::size_t digit(std::uint64_t tick, std::size_t level) noexcept {
+        return static_cast<std::size_t>((tick >> (s_slot_bits * level)) & (s_slots - 1));
+    }
+
+    void place(Timer &&timer) {
+        if (timer.due <= now) {
+            expired.push_back(std::move(timer));
+            return;
+        }
+        auto const delta = timer.due - now;
+        for (std::size_t level = 0; level < s_levels; ++level) {
+            if (delta < span(level + 1)) {
+                slots[level][digit(timer.due, level)].push_back(std::move(timer));
+                ++per_level[level];
+                return;
+            }
+        }
+        auto const parked = now + span(s_levels) - 1;
+        slots[s_levels - 1][digit(parked, s_levels - 1)].push_back(std::move(timer));
+        ++per_level[s_levels - 1];
+    }
+
+    // Empties a slot and places its timers again, relative to now.
+    void replace(std::size_t level, std::size_t index) {
+        auto &slot = slots[level][index];
+        if (slot.empty()) { return; }
+        per_level[level] -= slot.size();
+        scratch.swap(slot);
+        for (auto &timer : scratch) { place(std::move(timer)); }
+        scratch.clear();
+    }
+
+    template <typename Fire>
+    void fire_expired(Fire const &fire) {
+        for (auto &timer : expired) {
+            fire(std::move(timer.msg));
+            --count;
+        }
+        expired.clear();
+    }
+
+    std::array<std::array<Slot, s_slots>, s_levels> slots{};
+    std::array<std::size_t, s_levels> per_level{};
+    Slot expired{};
+    Slot scratch{};
+    std::uint64_t now{0};
+    std::size_t count{0};
+};
+
+// Runs a TimerWheel on its own thread and hands each message to
+// sink.enqueue_until() once it is due. Delivery may be late by up to one tick,
+// but never early. With retry, a sink that stays full is tried again one tick
+// at a time; otherwise the message goes wherever the sink's own policy sends
+// it. Messages still pending on destruction are dropped, including one
+// waiting for room, so destruction never waits on a full sink.
+template <std::movable Mtype, typename Sink>
+class DelayLine {
+    using Clock = std::chrono::steady_clock;
+
+public:
+    explicit DelayLine(Sink &sink_, bool retry_, Clock::duration tick_ = std::chrono::milliseconds{1})
+        : sink{sink_}
+        , retry{retry_}
+        , tick{tick_}
+        , worker{[this] { run(); }} {}
+    DelayLine(DelayLine const &) = delete;
+    DelayLine(DelayLine &&) = delete;
+    DelayLine &operator=(DelayLine const &) = delete;
+    DelayLine &operator=(DelayLine &&) = delete;
+    ~DelayLine() {
+        {
+            std::lock_guard lck{mutex};
+            stopping.store(true, std::memory_order_relaxed);
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    void schedule(Mtype &&msg, Clock::time_point due) {
+        bool earlier{};
+        {
+            std::lock_guard lck{mutex};
+            if (wheel.empty()) {
+                // Catch up at once on the time the wheel spent idle.
+                wheel.advance(ticks(Clock::now() - epoch, false), [](Mtype &&) {});
+            }
+            auto const at = ticks(due - epoch, true);
+            auto const next = wheel.next_expiry();
+            earlier = !next || at < *next;
+            wheel.insert(at, std::move(msg));
+        }
+        if (earlier) { wake.notify_one(); }
+    }
+
+private:
+    [[nodiscard]] std::uint64_t ticks(Clock::duration since, bool round_up) const {
+        if (since <= Clock::duration::zero()) { return 0; }
+        auto const whole = since / tick;
+        auto const n = static_cast<std::uint64_t>(whole);
+        return round_up && since % tick != Clock::duration::zero() ? n + 1 : n;
+    }
+
+    void run() {
+        std::vector<Mtype> due{};
+        std::unique_lock lck{mutex};
+        while (!stopping.load(std::memory_order_relaxed)) {
+            wheel.advance(ticks(Clock::now() - epoch, false),
+                          [&due](Mtype &&msg) { due.push_back(std::move(msg)); });
+            if (!due.empty()) {
+                // The sink may block, so deliver without the mutex.
+                lck.unlock();
+                for (auto &msg : due) { deliver(std::move(msg)); }
+                due.clear();
+                lck.lock();
+                continue;
+            }
+            if (auto const next = wheel.next_expiry()) {
+                wake.wait_until(lck, epoch + static_cast<Clock::rep>(*next) * tick);
+            } else {
+                wake.wait(lck);
+            }
+        }
+    }
+
+    // A message the sink turned down is left untouched, ready for the next
+    // try.
+    void deliver(Mtype &&msg) {
+        while (!sink.enqueue_until(std::move(msg), Clock::now() + tick)) {
+            if (!retry || stopping.load(std::memory_order_relaxed)) { return; }
+        }
+    }
+
+    Sink &sink;  // NOLINT
+    bool retry;
+    Clock::duration tick;
+    Clock::time_point epoch{Clock::now()};
+    std::mutex mutex{};
+    std::condition_variable wake{};
+    TimerWheel<Mtype> wheel{};
+    // Written with the mutex held, read without it while delivering.
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+};
+}  // namespace mq
+
+#endif
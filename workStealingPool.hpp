@@ -0,0 +1,261 @@
+#ifndef WORK_STEALING_POOL
+#define WORK_STEALING_POOL
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "chaseLevDeque.hpp"
+#include "ringBuffer.hpp"
+#include "semaphore.hpp"
+
+namespace mq {
+
+// Receiver pool in which every worker thread owns a ChaseLevDeque. A message
+// enqueued from inside the handler lands on the calling worker's deque, which
+// the worker drains LIFO while idle workers steal from the other end. Its box
+// comes from the worker's own free list and it is counted by the worker
+// alone, so recursive fan-out only writes to memory of the calling worker.
+// Messages enqueued from any other thread go through a bounded lock-free ring
+// that every worker polls.
+// Handler is called concurrently from all workers. Destruction waits until
+// every message has been handled, including those enqueued meanwhile.
+template <std::movable Mtype, typename Handler>
+    requires std::invocable<Handler const &, Mtype &&>
+class WorkStealingPool {
+    using StealResult = typename ChaseLevDeque<Mtype *>::StealResult;
+
+    inline static constexpr std::size_t s_default_size{1000};
+    // Boxes a worker keeps for reuse; the rest are freed.
+    inline static constexpr std::size_t s_spare_boxes{256};
+
+    struct alignas(cache_line_size) Worker {
+        Worker() = default;
+        Worker(Worker const &) = delete;
+        Worker(Worker &&) = delete;
+        Worker &operator=(Worker const &) = delete;
+        Worker &operator=(Worker &&) = delete;
+        ~Worker() {
+            for (auto *storage : spare) { std::allocator<Mtype>{}.deallocate(storage, 1); }
+        }
+
+        // Messages are boxed on the deque, which only holds trivially
+        // copyable elements.
+        ChaseLevDeque<Mtype *> local{};
+        std::thread thread{};
+        // Written by this worker only, read by wait_idle.
+        std::atomic<std::size_t> spawned{0};
+        std::atomic<std::size_t> handled{0};
+        // Storage of boxes this worker unboxed, for the messages it enqueues.
+        std::vector<Mtype *> spare{};
+    };
+
+public:
+    using value_type = Mtype;
+
+    // injected_size bounds the messages waiting to be picked up from threads
+    // outside the pool.
+    explicit WorkStealingPool(Handler handler_,
+                              std::size_t worker_count = std::max(std::thread::hardware_concurrency(), 1U),
+                              std::size_t injected_size = s_default_size)
+        : handler{std::move(handler_)}
+        , count{std::max(worker_count, std::size_t{1})}
+        , workers{std::make_unique<Worker[]>(count)}  // NOLINT
+        , injected{injected_size} {
+        for (std::size_t i = 0; i < count; ++i) {
+            workers[i].thread = std::thread{[this, i] { run(i); }};
+        }
+    }
+    WorkStealingPool(WorkStealingPool const &) = delete;
+    WorkStealingPool(WorkStealingPool &&) = delete;
+    WorkStealingPool &operator=(WorkStealingPool const &) = delete;
+    WorkStealingPool &operator=(WorkStealingPool &&) = delete;
+    ~WorkStealingPool() {
+        wait_idle();
+        stopping.store(true, std::memory_order_relaxed);
+        work_available.notify_all();
+        for (std::size_t i = 0; i < count; ++i) { workers[i].thread.join(); }
+    }
+
+    // Only waits when called from outside the pool and the ring is full.
+    bool enqueue(Mtype &&msg) {
+        if (auto *self = current_worker()) {
+            bump(self->spawned);
+            self->local.push(box(*self, std::move(msg)));
+        } else {
+            injected_count.fetch_add(1, std::memory_order_relaxed);
+            injected.push(std::move(msg));
+        }
+        work_available.notify_one();
+        return true;
+    }
+
+    // Fails only when called from outside the pool and the ring is full.
+    bool try_enqueue(Mtype &&msg) {
+        if (current_worker() != nullptr) { return enqueue(std::move(msg)); }
+        injected_count.fetch_add(1, std::memory_order_relaxed);
+        if (!injected.try_push(std::move(msg))) {
+            injected_count.fetch_sub(1, std::memory_order_relaxed);
+            idle.notify_all();
+            return false;
+        }
+        work_available.notify_one();
+        return true;
+    }
+
+    template <typename... Args>
+    bool emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+        requires std::constructible_from<Mtype, Args &&...>
+    {
+        return try_enqueue(Mtype(std::forward<Args>(args)...));
+    }
+
+    // Blocks until every message enqueued so far, and every message those
+    // enqueued in turn, has been handled. Must not be called by a worker.
+    void wait_idle() {
+        while (!is_idle()) {
+            auto const key = idle.prepare_wait();
+            if (is_idle()) {
+                idle.cancel_wait();
+                break;
+            }
+            idle.wait(key);
+        }
+    }
+
+    [[nodiscard]] std::size_t worker_count() const noexcept { return count; }
+
+private:
+    // The worker of this pool running on the calling thread, if any.
+    Worker *current_worker() const noexcept {
+        return current_pool == this ? current : nullptr;
+    }
+
+    void run(std::size_t index) {
+        current_pool = this;
+        current = &workers[index];
+        for (;;) {
+            if (auto msg = find_work(index)) {
+                handle(std::move(*msg));
+                continue;
+            }
+            auto const key = work_available.prepare_wait();
+            if (auto msg = find_work(index)) {
+                work_available.cancel_wait();
+                handle(std::move(*msg));
+                continue;
+            }
+            if (stopping.load(std::memory_order_relaxed)) {
+                work_available.cancel_wait();
+                return;
+            }
+            // The pool can only become idle while a worker runs out of work.
+            idle.notify_all();
+            work_available.wait(key);
+        }
+    }
+
+    // Own deque first, then the ring, then the other deques starting with
+    // the next worker along.
+    std::optional<Mtype> find_work(std::size_t index) {
+        auto &self = workers[index];
+        if (auto boxed = self.local.take()) { return unbox(self, *boxed); }
+        std::optional<Mtype> msg{};
+        if (injected.try_pop(msg) == RingBuffer<Mtype>::PopResult::TAKEN) {
+            return msg;
+        }
+        for (bool contended = true; contended;) {
+            contended = false;
+            for (std::size_t i = 1; i < count; ++i) {
+                Mtype *boxed{nullptr};
+                switch (workers[(index + i) % count].local.steal(boxed)) {
+                case StealResult::TAKEN:
+                    return unbox(self, boxed);
+                case StealResult::LOST_RACE:
+                    contended = true;
+                    break;
+                case StealResult::EMPTY:
+                    break;
+                }
+            }
+        }
+        return {};
+    }
+
+    static Mtype *box(Worker &self, Mtype &&msg) {
+        Mtype *storage{nullptr};
+        if (self.spare.empty()) {
+            storage = std::allocator<Mtype>{}.allocate(1);
+        } else {
+            storage = self.spare.back();
+            self.spare.pop_back();
+        }
+        return std::construct_at(storage, std::move(msg));
+    }
+
+    static Mtype unbox(Worker &self, Mtype *boxed) {
+        Mtype msg{std::move(*boxed)};
+        std::destroy_at(boxed);
+        if (self.spare.size() < s_spare_boxes) {
+            self.spare.push_back(boxed);
+        } else {
+            std::allocator<Mtype>{}.deallocate(boxed, 1);
+        }
+        return msg;
+    }
+
+    void handle(Mtype &&msg) {
+        std::invoke(handler, std::move(msg));
+        bump(current->handled);
+    }
+
+    // Single writer, so no read-modify-write.
+    static void bump(std::atomic<std::size_t> &counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Reads every handled count before any enqueued one: a message is
+    // counted as enqueued before it can be handled, and before the handler
+    // of its parent returns, so equal sums mean nothing is left.
+    [[nodiscard]] bool is_idle() const {
+        std::size_t handled{0};
+        for (std::size_t i = 0; i < count; ++i) {
+            handled += workers[i].handled.load(std::memory_order_acquire);
+        }
+        auto enqueued = injected_count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count; ++i) {
+            enqueued += workers[i].spawned.load(std::memory_order_acquire);
+        }
+        return enqueued == handled;
+    }
+
+    inline static thread_local WorkStealingPool const *current_pool{nullptr};
+    inline static thread_local Worker *current{nullptr};
+
+    [[no_unique_address]] Handler handler;
+    std::size_t count;
+    std::unique_ptr<Worker[]> workers;  // NOLINT
+    RingBuffer<Mtype> injected;
+    // Messages enqueued from outside the pool.
+    alignas(cache_line_size) std::atomic<std::size_t> injected_count{0};
+    std::atomic<bool> stopping{false};
+    alignas(cache_line_size) sem::EventCount work_available{};
+    alignas(cache_line_size) sem::EventCount idle{};
+};
+}  // namespace mq
+
+#endif